@@ -0,0 +1,182 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#include <gio/gunixfdlist.h>
+
+#include "mock-logind.h"
+
+#define LOGIND_SERVICE "org.freedesktop.login1"
+#define LOGIND_PATH    "/org/freedesktop/login1"
+#define LOGIND_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+#define LOGIND_SESSION_INTERFACE "org.freedesktop.login1.Session"
+
+static void inhibit(MockLogind *logind, GDBusMethodInvocation *invocation);
+static gboolean inhibitor_released_cb(gint fd, GIOCondition condition, gpointer user_data);
+static void method_call_cb(GDBusConnection *connection, const gchar *sender, const gchar *object_path, const gchar *interface_name, const gchar *method_name, GVariant *parameters, GDBusMethodInvocation *invocation, gpointer user_data);
+static void name_acquired_cb(GDBusConnection *connection, const gchar *name, gpointer user_data);
+
+static const gchar introspection_xml[] =
+    "<node>"
+    "  <interface name='" LOGIND_MANAGER_INTERFACE "'>"
+    "    <method name='Inhibit'>"
+    "      <arg type='s' name='what' direction='in'/>"
+    "      <arg type='s' name='who' direction='in'/>"
+    "      <arg type='s' name='why' direction='in'/>"
+    "      <arg type='s' name='mode' direction='in'/>"
+    "      <arg type='h' name='fd' direction='out'/>"
+    "    </method>"
+    "    <method name='GetSession'>"
+    "      <arg type='s' name='id' direction='in'/>"
+    "      <arg type='o' name='session' direction='out'/>"
+    "    </method>"
+    "    <method name='GetSessionByPID'>"
+    "      <arg type='u' name='pid' direction='in'/>"
+    "      <arg type='o' name='session' direction='out'/>"
+    "    </method>"
+    "    <signal name='PrepareForSleep'>"
+    "      <arg type='b' name='active'/>"
+    "    </signal>"
+    "  </interface>"
+    "  <interface name='" LOGIND_SESSION_INTERFACE "'>"
+    "    <method name='SetIdleHint'>"
+    "      <arg type='b' name='idle' direction='in'/>"
+    "    </method>"
+    "    <signal name='Lock'/>"
+    "    <signal name='Unlock'/>"
+    "  </interface>"
+    "</node>";
+
+static const GDBusInterfaceVTable interface_vtable = {method_call_cb};
+
+static GDBusNodeInfo *introspection_data = NULL;
+
+static void
+inhibit(MockLogind *logind, GDBusMethodInvocation *invocation)
+{
+    GUnixFDList *fd_list;
+    gint fds[2];
+    GError *error = NULL;
+
+    logind->inhibit_calls++;
+    if (!g_unix_open_pipe(fds, FD_CLOEXEC, &error)) {
+        g_dbus_method_invocation_return_gerror(invocation, error);
+        g_error_free(error);
+        return;
+    }
+
+    fd_list = g_unix_fd_list_new_from_array(&fds[1], 1);
+    g_unix_fd_add(fds[0], G_IO_HUP | G_IO_ERR, inhibitor_released_cb, logind);
+    logind->inhibitors++;
+
+    g_dbus_method_invocation_return_value_with_unix_fd_list(
+        invocation, g_variant_new("(h)", 0), fd_list);
+    g_object_unref(fd_list);
+}
+
+static gboolean
+inhibitor_released_cb(gint fd, GIOCondition condition, gpointer user_data)
+{
+    MockLogind *logind = user_data;
+
+    logind->last_release_time = g_get_monotonic_time();
+    logind->inhibitors--;
+    close(fd);
+    return FALSE;
+}
+
+static void
+method_call_cb(GDBusConnection *connection, const gchar *sender,
+               const gchar *object_path, const gchar *interface_name,
+               const gchar *method_name, GVariant *parameters,
+               GDBusMethodInvocation *invocation, gpointer user_data)
+{
+    MockLogind *logind = user_data;
+
+    if (!g_strcmp0(method_name, "Inhibit")) {
+        inhibit(logind, invocation);
+    } else if (!g_strcmp0(method_name, "GetSession")
+               || !g_strcmp0(method_name, "GetSessionByPID")) {
+        logind->get_session_calls++;
+        g_dbus_method_invocation_return_value(
+            invocation, g_variant_new("(o)", MOCK_LOGIND_SESSION_PATH));
+    } else if (!g_strcmp0(method_name, "SetIdleHint")) {
+        g_variant_get(parameters, "(b)", &logind->idle_hint);
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    }
+}
+
+static void
+name_acquired_cb(GDBusConnection *connection, const gchar *name,
+                 gpointer user_data)
+{
+    ((MockLogind *)user_data)->name_owned = TRUE;
+}
+
+MockLogind *
+mock_logind_new(GDBusConnection *connection, GError **error)
+{
+    MockLogind *logind;
+
+    if (!introspection_data)
+        introspection_data = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+
+    logind = g_new0(MockLogind, 1);
+    logind->connection = g_object_ref(connection);
+    logind->registration_ids[0] =
+        g_dbus_connection_register_object(connection, LOGIND_PATH,
+                                          introspection_data->interfaces[0],
+                                          &interface_vtable, logind, NULL, error);
+    if (logind->registration_ids[0])
+        logind->registration_ids[1] =
+            g_dbus_connection_register_object(connection, MOCK_LOGIND_SESSION_PATH,
+                                              introspection_data->interfaces[1],
+                                              &interface_vtable, logind, NULL, error);
+    if (!logind->registration_ids[1]) {
+        mock_logind_free(logind);
+        return NULL;
+    }
+
+    logind->owner_id =
+        g_bus_own_name_on_connection(connection, LOGIND_SERVICE,
+                                     G_BUS_NAME_OWNER_FLAGS_NONE,
+                                     name_acquired_cb, NULL, logind, NULL);
+    return logind;
+}
+
+void
+mock_logind_free(MockLogind *logind)
+{
+    guint i;
+
+    if (logind->owner_id)
+        g_bus_unown_name(logind->owner_id);
+    for (i = 0; i < G_N_ELEMENTS(logind->registration_ids); i++)
+        if (logind->registration_ids[i])
+            g_dbus_connection_unregister_object(logind->connection,
+                                                logind->registration_ids[i]);
+    g_object_unref(logind->connection);
+    g_free(logind);
+}
+
+void
+mock_logind_prepare_for_sleep(MockLogind *logind, gboolean active)
+{
+    g_dbus_connection_emit_signal(logind->connection, NULL, LOGIND_PATH,
+                                  LOGIND_MANAGER_INTERFACE, "PrepareForSleep",
+                                  g_variant_new("(b)", active), NULL);
+    g_dbus_connection_flush_sync(logind->connection, NULL, NULL);
+}
+
+void
+mock_logind_lock(MockLogind *logind, gboolean lock)
+{
+    g_dbus_connection_emit_signal(logind->connection, NULL,
+                                  MOCK_LOGIND_SESSION_PATH,
+                                  LOGIND_SESSION_INTERFACE,
+                                  lock ? "Lock" : "Unlock", NULL, NULL);
+    g_dbus_connection_flush_sync(logind->connection, NULL, NULL);
+}
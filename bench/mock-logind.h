@@ -0,0 +1,41 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef MOCK_LOGIND_H
+#define MOCK_LOGIND_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define MOCK_LOGIND_SESSION_PATH "/org/freedesktop/login1/session/bench"
+
+/* Stand-in for the parts of systemd-logind that xss-lock talks to. Every
+ * client gets the same session; delay locks are pipes whose read end is kept
+ * here, so that their release can be timed.
+ */
+typedef struct MockLogind {
+    gboolean  name_owned;
+    guint     inhibit_calls;
+    guint     get_session_calls;
+    guint     inhibitors;           /* delay locks currently held */
+    gint64    last_release_time;
+    gboolean  idle_hint;
+
+    GDBusConnection *connection;
+    guint            owner_id;
+    guint            registration_ids[2];
+} MockLogind;
+
+MockLogind *mock_logind_new(GDBusConnection *connection, GError **error);
+
+void mock_logind_free(MockLogind *logind);
+
+void mock_logind_prepare_for_sleep(MockLogind *logind, gboolean active);
+
+void mock_logind_lock(MockLogind *logind, gboolean lock);
+
+G_END_DECLS
+
+#endif /* MOCK_LOGIND_H */
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Run a benchmark against a private headless X server and a private D-Bus
+# daemon standing in for the system bus, so that nothing on the host is
+# touched and no network access is needed.
+#
+# Usage: run-bench.sh COMMAND [ARG...]
+# e.g.:  run-bench.sh xss-lock-bench -i 200 -- xss-lock --standby
+#
+# Exits with 77, which ctest takes as skipped, if either server is missing.
+
+for server in Xvfb dbus-daemon; do
+    if ! command -v $server >/dev/null; then
+        echo "$server not found; skipping" >&2
+        exit 77
+    fi
+done
+
+tmp=$(mktemp -d) || exit
+trap 'kill $xvfb_pid $dbus_pid 2>/dev/null; rm -rf "$tmp"' EXIT INT TERM
+
+Xvfb -displayfd 3 -nolisten tcp -screen 0 640x480x24 3>"$tmp/display" 2>/dev/null &
+xvfb_pid=$!
+dbus-daemon --session --nofork --address="unix:path=$tmp/bus" &
+dbus_pid=$!
+
+for i in $(seq 50); do
+    [ -s "$tmp/display" ] && [ -S "$tmp/bus" ] && break
+    sleep 0.1
+done
+if [ ! -s "$tmp/display" ] || [ ! -S "$tmp/bus" ]; then
+    echo "Failed to start Xvfb or dbus-daemon" >&2
+    exit 1
+fi
+
+export DISPLAY=":$(cat "$tmp/display")"
+export DBUS_SYSTEM_BUS_ADDRESS="unix:path=$tmp/bus"
+export DBUS_SESSION_BUS_ADDRESS="$DBUS_SYSTEM_BUS_ADDRESS"
+"$@"
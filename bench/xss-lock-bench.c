@@ -0,0 +1,689 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+#include <xcb/xcb.h>
+
+#include "mock-logind.h"
+
+#define WAIT_TIMEOUT (5 * G_USEC_PER_SEC)
+#define SETTLE_TIME  50
+
+/* Resource use of the xss-lock process, as sampled during a soak run */
+typedef struct Resources {
+    guint64 rss_kib;
+    guint   fds;
+    guint   sources;
+    guint   zombies;
+} Resources;
+
+typedef enum {
+    SAMPLE_EXEC,
+    SAMPLE_RELEASE,
+    N_SAMPLES
+} SampleKind;
+
+typedef struct Scenario {
+    const gchar *name;
+    void       (*setup)(void);
+    void       (*trigger)(void);
+    void       (*finish)(void);
+    gboolean     sleep;
+    GArray      *samples[N_SAMPLES];
+} Scenario;
+
+static int run_locker(const gchar *path);
+static gboolean locker_accept_cb(gint fd, GIOCondition condition, gpointer user_data);
+static gboolean locker_report_cb(gint fd, GIOCondition condition, gpointer user_data);
+static void xss_lock_watch_cb(GPid pid, gint status, gpointer user_data);
+static gboolean wake_cb(gpointer user_data);
+static gboolean settled_cb(gpointer user_data);
+static void wait_for(gboolean (*condition)(void), const gchar *what);
+static void settle(guint ms);
+static gboolean logind_ready(void);
+static gboolean xss_lock_ready(void);
+static gboolean locker_ready(void);
+static gboolean locker_exited(void);
+static gboolean sleep_lock_taken(void);
+static void trigger_saver(void);
+static void finish_saver(void);
+static void trigger_lock(void);
+static void finish_lock(void);
+static void trigger_sleep(void);
+static void finish_sleep(void);
+static void setup_crash(void);
+static void trigger_crash(void);
+static void run_scenario(Scenario *scenario);
+static gint compare_samples(gconstpointer a, gconstpointer b);
+static void print_samples(const gchar *trigger, const gchar *stage, GArray *samples);
+static gboolean sample_resources(Resources *resources);
+static guint64 read_rss(void);
+static guint count_entries(const gchar *path);
+static guint count_zombies(void);
+static gboolean stats_written(void);
+static gboolean read_source_count(guint *sources);
+static gboolean run_soak(void);
+static gboolean check_footprint(gint64 startup);
+static gboolean parse_options(int argc, char *argv[], GError **error);
+
+static gint opt_iterations = 100;
+static gint opt_soak = 0;
+static gint opt_rss_slack = 256;
+static gboolean opt_footprint = FALSE;
+static gint opt_max_rss = 0;
+static gint opt_max_startup = 0;
+static gchar *opt_locker = NULL;
+static gchar **opt_xss_lock = NULL;
+
+static GOptionEntry opt_entries[] = {
+    {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &opt_xss_lock, NULL, "XSS_LOCK [ARG...]"},
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &opt_iterations, "Run every scenario N times (default: 100)", "N"},
+    {"soak", 's', 0, G_OPTION_ARG_INT, &opt_soak, "Instead of timing, run N rounds of all scenarios and check for leaks", "N"},
+    {"rss-slack", 0, 0, G_OPTION_ARG_INT, &opt_rss_slack, "Allow RSS to grow this much during a soak run (default: 256)", "KIB"},
+    {"footprint", 'f', 0, G_OPTION_ARG_NONE, &opt_footprint, "Instead of timing, measure startup time and resident memory", NULL},
+    {"max-rss", 0, 0, G_OPTION_ARG_INT, &opt_max_rss, "With --footprint, fail above this RSS", "KIB"},
+    {"max-startup", 0, 0, G_OPTION_ARG_INT, &opt_max_startup, "With --footprint, fail if startup takes longer", "MS"},
+    {"locker", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &opt_locker, NULL, NULL},
+    {NULL}
+};
+
+static xcb_connection_t *connection = NULL;
+static MockLogind *logind = NULL;
+static gint64 locker_exec_time = 0;
+static GPid locker_pid = 0;
+static guint lockers_connected = 0;
+static gboolean xss_lock_exited = FALSE;
+static GPid xss_lock_pid = 0;
+static gchar *stats_file = NULL;
+static Scenario *current = NULL;
+
+static Scenario scenarios[] = {
+    {"saver", NULL,        trigger_saver, finish_saver, FALSE},
+    {"lock",  NULL,        trigger_lock,  finish_lock,  FALSE},
+    {"sleep", NULL,        trigger_sleep, finish_sleep, TRUE},
+    {"crash", setup_crash, trigger_crash, finish_lock,  FALSE},
+};
+
+/* Started by xss-lock in place of a real locker: report when it got to run
+ * (or was activated, with --standby), signal readiness right away and stay
+ * until killed.
+ */
+static int
+run_locker(const gchar *path)
+{
+    gint64 exec_time = g_get_monotonic_time();
+    const gchar *standby_fd = g_getenv("XSS_STANDBY_FD");
+    const gchar *sleep_lock_fd = g_getenv("XSS_SLEEP_LOCK_FD");
+    const gchar *ready_fd = g_getenv("XSS_READY_FD");
+    struct sockaddr_un address = {AF_UNIX};
+    gchar *report;
+    gchar byte;
+    int sock;
+
+    if (standby_fd) {
+        union {
+            struct cmsghdr header;
+            char buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec iov = {&byte, 1};
+        struct msghdr msg = {NULL, 0, &iov, 1, &control, sizeof(control), 0};
+        struct cmsghdr *cmsg;
+
+        if (recvmsg(atoi(standby_fd), &msg, 0) != 1)
+            return EXIT_SUCCESS;
+        exec_time = g_get_monotonic_time();
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+                close(*(int *)CMSG_DATA(cmsg));
+        ready_fd = standby_fd;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    g_strlcpy(address.sun_path, path, sizeof(address.sun_path));
+    if (connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0)
+        return EXIT_FAILURE;
+    report = g_strdup_printf("%" G_GINT64_FORMAT " %d\n", exec_time, getpid());
+    if (write(sock, report, strlen(report)) < 0)
+        return EXIT_FAILURE;
+    g_free(report);
+
+    if (sleep_lock_fd)
+        close(atoi(sleep_lock_fd));
+    if (ready_fd && write(atoi(ready_fd), "", 1) < 0)
+        return EXIT_FAILURE;
+
+    while (read(sock, &byte, 1) > 0);
+    return EXIT_SUCCESS;
+}
+
+static gboolean
+locker_accept_cb(gint fd, GIOCondition condition, gpointer user_data)
+{
+    int sock = accept(fd, NULL, NULL);
+
+    if (sock >= 0) {
+        lockers_connected++;
+        g_unix_fd_add(sock, G_IO_IN | G_IO_HUP | G_IO_ERR, locker_report_cb, NULL);
+    }
+    return TRUE;
+}
+
+static gboolean
+locker_report_cb(gint fd, GIOCondition condition, gpointer user_data)
+{
+    gchar buffer[48], *end;
+    gssize length = read(fd, buffer, sizeof(buffer) - 1);
+
+    if (length > 0) {
+        buffer[length] = '\0';
+        locker_exec_time = g_ascii_strtoll(buffer, &end, 10);
+        locker_pid = g_ascii_strtoll(end, NULL, 10);
+        return TRUE;
+    }
+    lockers_connected--;
+    close(fd);
+    return FALSE;
+}
+
+static void
+xss_lock_watch_cb(GPid pid, gint status, gpointer user_data)
+{
+    xss_lock_exited = TRUE;
+    g_spawn_close_pid(pid);
+}
+
+static gboolean
+wake_cb(gpointer user_data)
+{
+    return TRUE;
+}
+
+static gboolean
+settled_cb(gpointer user_data)
+{
+    *(gboolean *)user_data = TRUE;
+    return FALSE;
+}
+
+static void
+wait_for(gboolean (*condition)(void), const gchar *what)
+{
+    gint64 deadline = g_get_monotonic_time() + WAIT_TIMEOUT;
+
+    while (!condition()) {
+        if (xss_lock_exited) {
+            g_printerr("xss-lock exited while waiting for %s\n", what);
+            exit(EXIT_FAILURE);
+        }
+        if (g_get_monotonic_time() > deadline) {
+            g_printerr("Timed out waiting for %s\n", what);
+            exit(EXIT_FAILURE);
+        }
+        g_main_context_iteration(NULL, TRUE);
+    }
+}
+
+static void
+settle(guint ms)
+{
+    gboolean done = FALSE;
+
+    g_timeout_add(ms, settled_cb, &done);
+    while (!done)
+        g_main_context_iteration(NULL, TRUE);
+}
+
+static gboolean
+logind_ready(void)
+{
+    return logind->name_owned;
+}
+
+static gboolean
+xss_lock_ready(void)
+{
+    return logind->inhibitors > 0 && logind->get_session_calls > 0;
+}
+
+/* For sleep, the locker only counts once the delay lock is gone as well */
+static gboolean
+locker_ready(void)
+{
+    return locker_exec_time && (!current->sleep || logind->inhibitors == 0);
+}
+
+/* A crashed locker may still be on its way out when the next one reports */
+static gboolean
+locker_exited(void)
+{
+    return lockers_connected == 0;
+}
+
+static gboolean
+sleep_lock_taken(void)
+{
+    return logind->inhibitors > 0;
+}
+
+static void
+trigger_saver(void)
+{
+    xcb_force_screen_saver(connection, XCB_SCREEN_SAVER_ACTIVE);
+    xcb_flush(connection);
+}
+
+static void
+finish_saver(void)
+{
+    mock_logind_lock(logind, FALSE);
+    xcb_force_screen_saver(connection, XCB_SCREEN_SAVER_RESET);
+    xcb_flush(connection);
+}
+
+static void
+trigger_lock(void)
+{
+    mock_logind_lock(logind, TRUE);
+}
+
+static void
+finish_lock(void)
+{
+    mock_logind_lock(logind, FALSE);
+}
+
+static void
+trigger_sleep(void)
+{
+    mock_logind_prepare_for_sleep(logind, TRUE);
+}
+
+static void
+finish_sleep(void)
+{
+    mock_logind_lock(logind, FALSE);
+    mock_logind_prepare_for_sleep(logind, FALSE);
+    wait_for(sleep_lock_taken, "sleep delay lock");
+}
+
+/* Times the restart of a locker that crashed while the session is locked */
+static void
+setup_crash(void)
+{
+    mock_logind_lock(logind, TRUE);
+    wait_for(locker_ready, "crash setup");
+    locker_exec_time = 0;
+}
+
+static void
+trigger_crash(void)
+{
+    kill(locker_pid, SIGKILL);
+}
+
+static void
+run_scenario(Scenario *scenario)
+{
+    gint i;
+
+    current = scenario;
+    for (i = 0; i < N_SAMPLES; i++)
+        if (!scenario->samples[i])
+            scenario->samples[i] = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+    for (i = 0; i < opt_iterations; i++) {
+        gint64 trigger_time, latency;
+
+        locker_exec_time = 0;
+        if (scenario->setup)
+            scenario->setup();
+        trigger_time = g_get_monotonic_time();
+        scenario->trigger();
+        wait_for(locker_ready, scenario->name);
+
+        latency = locker_exec_time - trigger_time;
+        g_array_append_val(scenario->samples[SAMPLE_EXEC], latency);
+        if (scenario->sleep) {
+            latency = logind->last_release_time - trigger_time;
+            g_array_append_val(scenario->samples[SAMPLE_RELEASE], latency);
+        }
+
+        scenario->finish();
+        wait_for(locker_exited, "locker to exit");
+        settle(SETTLE_TIME);
+    }
+}
+
+static gint
+compare_samples(gconstpointer a, gconstpointer b)
+{
+    gint64 sample_a = *(const gint64 *)a, sample_b = *(const gint64 *)b;
+
+    return (sample_a > sample_b) - (sample_a < sample_b);
+}
+
+static void
+print_samples(const gchar *trigger, const gchar *stage, GArray *samples)
+{
+    static const guint percentiles[] = {50, 90, 99};
+    guint i;
+
+    if (!samples->len)
+        return;
+
+    g_array_sort(samples, compare_samples);
+    g_print("%-8s %-8s %6u", trigger, stage, samples->len);
+    for (i = 0; i < G_N_ELEMENTS(percentiles); i++)
+        g_print(" %9" G_GINT64_FORMAT,
+                g_array_index(samples, gint64,
+                              (samples->len - 1) * percentiles[i] / 100));
+    g_print(" %9" G_GINT64_FORMAT "\n",
+            g_array_index(samples, gint64, samples->len - 1));
+}
+
+/* Sources are only known to xss-lock itself; the rest comes from /proc */
+static gboolean
+sample_resources(Resources *resources)
+{
+    gchar *fd_dir = g_strdup_printf("/proc/%d/fd", xss_lock_pid);
+
+    resources->rss_kib = read_rss();
+    resources->fds = count_entries(fd_dir);
+    resources->zombies = count_zombies();
+    g_free(fd_dir);
+    return read_source_count(&resources->sources);
+}
+
+static guint64
+read_rss(void)
+{
+    gchar *path = g_strdup_printf("/proc/%d/status", xss_lock_pid);
+    gchar *status = NULL, *line;
+    guint64 rss_kib = 0;
+
+    if (g_file_get_contents(path, &status, NULL, NULL)
+        && (line = strstr(status, "\nVmRSS:")))
+        rss_kib = g_ascii_strtoull(line + strlen("\nVmRSS:"), NULL, 10);
+    g_free(status);
+    g_free(path);
+    return rss_kib;
+}
+
+static guint
+count_entries(const gchar *path)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    guint count = 0;
+
+    if (!dir)
+        return 0;
+    while (g_dir_read_name(dir))
+        count++;
+    g_dir_close(dir);
+    return count;
+}
+
+static guint
+count_zombies(void)
+{
+    GDir *dir = g_dir_open("/proc", 0, NULL);
+    const gchar *name;
+    guint count = 0;
+
+    if (!dir)
+        return 0;
+    while ((name = g_dir_read_name(dir))) {
+        gchar *path, *stat = NULL, *fields;
+        gchar state;
+        int ppid;
+
+        if (!g_ascii_isdigit(*name))
+            continue;
+        path = g_strdup_printf("/proc/%s/stat", name);
+        /* The command name may contain anything, up to the last ')' */
+        if (g_file_get_contents(path, &stat, NULL, NULL)
+            && (fields = strrchr(stat, ')'))
+            && sscanf(fields + 1, " %c %d", &state, &ppid) == 2
+            && state == 'Z' && ppid == xss_lock_pid)
+            count++;
+        g_free(stat);
+        g_free(path);
+    }
+    g_dir_close(dir);
+    return count;
+}
+
+static gboolean
+stats_written(void)
+{
+    return g_file_test(stats_file, G_FILE_TEST_EXISTS);
+}
+
+static gboolean
+read_source_count(guint *sources)
+{
+    gchar *stats = NULL, *field;
+    gboolean found;
+
+    unlink(stats_file);
+    kill(xss_lock_pid, SIGUSR2);
+    wait_for(stats_written, "statistics");
+
+    found = g_file_get_contents(stats_file, &stats, NULL, NULL)
+            && (field = strstr(stats, "\"sources\":"));
+    if (found)
+        *sources = strtoul(field + strlen("\"sources\":"), NULL, 10);
+    g_free(stats);
+    return found;
+}
+
+/* Every round repeats all scenarios; the first tenth of the run is taken as
+ * warm-up, after which resource use must stay flat.
+ */
+static gboolean
+run_soak(void)
+{
+    Resources baseline, resources;
+    gint warmup = MAX(opt_soak / 10, 1);
+    gint round, sample_interval = MAX(opt_soak / 20, 1);
+    gboolean leaked = FALSE;
+    guint i;
+
+    opt_iterations = 1;
+    g_print("%8s %10s %6s %8s %8s\n", "round", "rss_kib", "fds", "sources", "zombies");
+    for (round = 1; round <= opt_soak; round++) {
+        for (i = 0; i < G_N_ELEMENTS(scenarios); i++)
+            run_scenario(&scenarios[i]);
+
+        if (round != warmup && round % sample_interval && round != opt_soak)
+            continue;
+        if (!sample_resources(&resources)) {
+            g_printerr("Failed to read statistics of xss-lock\n");
+            return FALSE;
+        }
+        g_print("%8d %10" G_GUINT64_FORMAT " %6u %8u %8u\n", round,
+                resources.rss_kib, resources.fds, resources.sources,
+                resources.zombies);
+        if (round == warmup)
+            baseline = resources;
+    }
+
+    if (resources.rss_kib > baseline.rss_kib + opt_rss_slack) {
+        g_printerr("RSS grew from %" G_GUINT64_FORMAT " to %" G_GUINT64_FORMAT " KiB\n",
+                   baseline.rss_kib, resources.rss_kib);
+        leaked = TRUE;
+    }
+    if (resources.fds > baseline.fds) {
+        g_printerr("Open fds grew from %u to %u\n", baseline.fds, resources.fds);
+        leaked = TRUE;
+    }
+    if (resources.sources > baseline.sources) {
+        g_printerr("Sources grew from %u to %u\n", baseline.sources, resources.sources);
+        leaked = TRUE;
+    }
+    if (resources.zombies) {
+        g_printerr("%u zombie children left\n", resources.zombies);
+        leaked = TRUE;
+    }
+    return !leaked;
+}
+
+/* Startup runs from spawning xss-lock to the point where it has both
+ * inhibited sleep and looked up its session; RSS is taken once it has
+ * settled after that.
+ */
+static gboolean
+check_footprint(gint64 startup)
+{
+    guint64 rss_kib = read_rss();
+    gboolean within = TRUE;
+
+    g_print("%-12s %10" G_GINT64_FORMAT " us\n", "startup", startup);
+    g_print("%-12s %10" G_GUINT64_FORMAT " KiB\n", "rss", rss_kib);
+    if (opt_max_startup && startup > opt_max_startup * (gint64)1000) {
+        g_printerr("Startup took %" G_GINT64_FORMAT " us, over the budget of %d ms\n",
+                   startup, opt_max_startup);
+        within = FALSE;
+    }
+    if (opt_max_rss && rss_kib > (guint64)opt_max_rss) {
+        g_printerr("RSS is %" G_GUINT64_FORMAT " KiB, over the budget of %d KiB\n",
+                   rss_kib, opt_max_rss);
+        within = FALSE;
+    }
+    return within;
+}
+
+static gboolean
+parse_options(int argc, char *argv[], GError **error)
+{
+    GOptionContext *opt_context;
+    gboolean success;
+
+    opt_context = g_option_context_new("- measure xss-lock locking latency");
+    g_option_context_set_summary(opt_context,
+        "Runs XSS_LOCK against the X server in $DISPLAY and a mock login\n"
+        "manager on the bus in $DBUS_SYSTEM_BUS_ADDRESS.");
+    g_option_context_add_main_entries(opt_context, opt_entries, NULL);
+    success = g_option_context_parse(opt_context, &argc, &argv, error);
+    g_option_context_free(opt_context);
+
+    if (success && !opt_locker && !opt_xss_lock) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                    "No xss-lock command specified");
+        success = FALSE;
+    }
+    return success;
+}
+
+int
+main(int argc, char *argv[])
+{
+    GDBusConnection *bus;
+    GError *error = NULL;
+    struct sockaddr_un address = {AF_UNIX};
+    gchar *dir, *self;
+    GPtrArray *xss_lock_argv;
+    gchar **arg;
+    gboolean success = TRUE;
+    gint64 spawn_time, startup;
+    guint i;
+    int sock;
+
+    if (!parse_options(argc, argv, &error)) {
+        g_printerr("%s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+    if (opt_locker)
+        return run_locker(opt_locker);
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+    g_type_init();
+#endif
+
+    connection = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(connection)) {
+        g_printerr("Connecting to X server failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!(bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error))
+        || !(logind = mock_logind_new(bus, &error))) {
+        g_printerr("%s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+    g_timeout_add(100, wake_cb, NULL);
+    wait_for(logind_ready, "login manager name");
+
+    dir = g_dir_make_tmp("xss-lock-bench-XXXXXX", NULL);
+    g_snprintf(address.sun_path, sizeof(address.sun_path), "%s/locker", dir);
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0
+        || listen(sock, 4) < 0) {
+        g_printerr("Failed to listen on %s\n", address.sun_path);
+        exit(EXIT_FAILURE);
+    }
+    g_unix_fd_add(sock, G_IO_IN, locker_accept_cb, NULL);
+
+    self = g_file_read_link("/proc/self/exe", NULL);
+    xss_lock_argv = g_ptr_array_new();
+    for (arg = opt_xss_lock; *arg; arg++)
+        g_ptr_array_add(xss_lock_argv, *arg);
+    if (opt_soak) {
+        stats_file = g_build_filename(dir, "stats", NULL);
+        g_ptr_array_add(xss_lock_argv, "--stats-file");
+        g_ptr_array_add(xss_lock_argv, stats_file);
+    }
+    g_ptr_array_add(xss_lock_argv, "--");
+    g_ptr_array_add(xss_lock_argv, self);
+    g_ptr_array_add(xss_lock_argv, "--locker");
+    g_ptr_array_add(xss_lock_argv, address.sun_path);
+    g_ptr_array_add(xss_lock_argv, NULL);
+
+    spawn_time = g_get_monotonic_time();
+    if (!g_spawn_async(NULL, (gchar **)xss_lock_argv->pdata, NULL,
+                       G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                       NULL, NULL, &xss_lock_pid, &error)) {
+        g_printerr("%s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+    g_child_watch_add(xss_lock_pid, xss_lock_watch_cb, NULL);
+    wait_for(xss_lock_ready, "xss-lock to start");
+    startup = g_get_monotonic_time() - spawn_time;
+    settle(200);
+
+    if (opt_footprint) {
+        success = check_footprint(startup);
+        goto out;
+    }
+
+    if (opt_soak) {
+        success = run_soak();
+        goto out;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(scenarios); i++)
+        run_scenario(&scenarios[i]);
+
+    g_print("%-8s %-8s %6s %9s %9s %9s %9s  (microseconds)\n",
+            "trigger", "stage", "n", "p50", "p90", "p99", "max");
+    for (i = 0; i < G_N_ELEMENTS(scenarios); i++) {
+        print_samples(scenarios[i].name, "exec", scenarios[i].samples[SAMPLE_EXEC]);
+        print_samples(scenarios[i].name, "release", scenarios[i].samples[SAMPLE_RELEASE]);
+    }
+
+out:
+    kill(xss_lock_pid, SIGTERM);
+    if (stats_file)
+        unlink(stats_file);
+    unlink(address.sun_path);
+    rmdir(dir);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
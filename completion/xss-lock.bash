@@ -2,23 +2,27 @@ _xss-lock() {
     local cur prev words cword
     _init_completion || return
 
-    local i notifier=@(-n|--notifier)
+    local i notifier=@(-n|--notifier) config=@(-c|--config)
     for (( i=1; i <= COMP_CWORD; i++ )); do
         if [[ ${COMP_WORDS[i]} != -* ]]; then
             _command_offset $i
             return
-        elif [[ ${COMP_WORDS[i]} == $notifier ]]; then
+        elif [[ ${COMP_WORDS[i]} == @($notifier|$config) ]]; then
             (( i++ ))
         fi
     done
 
     if [[ $prev == $notifier ]]; then
         COMPREPLY=( $(compgen -c -- $cur) )
+    elif [[ $prev == $config ]]; then
+        _filedir
     fi
 
     if [[ $cur == -* ]]; then
-        COMPREPLY=( $(compgen -W '-n --notifier -l --transfer-sleep-lock \
-                                  --ignore-sleep -q --quiet -v --verbose \
+        COMPREPLY=( $(compgen -W '-n --notifier --dim -l --transfer-sleep-lock \
+                                  --idle-hint-delay --ignore-sleep --inhibit-fullscreen --inhibit-service --kill-timeout --locker-for --ready-timeout --record --replay --sleep-nice --standby \
+                                  --stats-file -c --config --attach --idle-stage \
+                                  -q --quiet -v --verbose \
                                   --version -h --help' -- $cur) )
     fi
 }
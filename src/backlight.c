@@ -0,0 +1,378 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include "backlight.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <glib-unix.h>
+#include <xcb/randr.h>
+
+#define BACKLIGHT_FRAME_INTERVAL 16667 /* microseconds */
+#define BACKLIGHT_SYSFS_DIR "/sys/class/backlight"
+
+/* Ratio between the saved level and the last step of an exponential fade */
+#define BACKLIGHT_EXPONENTIAL_RANGE 100.0
+
+/* Either a RandR output property or a sysfs brightness file; the level is
+ * saved when a fade starts and written back when it is restored.
+ */
+struct Backlight {
+    xcb_connection_t  *connection;
+    xcb_randr_output_t output;
+    xcb_atom_t         atom;
+    gint               sysfs_fd;
+    gint32             minimum;
+    gint32             maximum;
+    gint32             saved;
+    gint32             level;
+    gboolean           dimmed;
+    gint               timer_fd;
+    guint              timer_watch;
+    gint64             fade_start;
+    gint64             fade_duration;
+    BacklightCurve     curve;
+};
+
+static gboolean randr_find_output(Backlight *backlight, xcb_window_t root);
+static gboolean sysfs_find_device(Backlight *backlight);
+static gboolean backlight_get(Backlight *backlight, gint32 *level);
+static void backlight_set(Backlight *backlight, gint32 level);
+static gdouble curve_remaining(BacklightCurve curve, gdouble progress);
+static gboolean fade_step_cb(gint fd, GIOCondition condition, Backlight *backlight);
+static void fade_stop(Backlight *backlight);
+
+static const gchar *const curve_names[BACKLIGHT_N_CURVES] = {
+    "linear", "ease", "exponential"
+};
+
+GQuark
+backlight_error_quark(void)
+{
+    return g_quark_from_static_string("backlight-error-quark");
+}
+
+gboolean
+backlight_curve_from_string(const gchar *name, BacklightCurve *curve)
+{
+    guint i;
+
+    for (i = 0; i < BACKLIGHT_N_CURVES; i++) {
+        if (!strcmp(name, curve_names[i])) {
+            *curve = i;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+Backlight *
+backlight_new(xcb_connection_t *connection, xcb_window_t root, GError **error)
+{
+    Backlight *backlight = g_new0(Backlight, 1);
+
+    backlight->connection = connection;
+    backlight->sysfs_fd = -1;
+    backlight->timer_fd = -1;
+
+    if (!randr_find_output(backlight, root) && !sysfs_find_device(backlight)) {
+        g_set_error(error, BACKLIGHT_ERROR, 0,
+                    "No RandR backlight property or writable sysfs backlight");
+        goto error;
+    }
+
+    backlight->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                         TFD_NONBLOCK | TFD_CLOEXEC);
+    if (backlight->timer_fd < 0) {
+        g_set_error(error, BACKLIGHT_ERROR, 0, "Error creating timer: %s",
+                    g_strerror(errno));
+        goto error;
+    }
+    return backlight;
+
+error:
+    backlight_free(backlight);
+    return NULL;
+}
+
+void
+backlight_free(Backlight *backlight)
+{
+    backlight_restore(backlight);
+    if (backlight->timer_fd >= 0) close(backlight->timer_fd);
+    if (backlight->sysfs_fd >= 0) close(backlight->sysfs_fd);
+    g_free(backlight);
+}
+
+/* Like xbacklight, use the first output with a ranged backlight property */
+static gboolean
+randr_find_output(Backlight *backlight, xcb_window_t root)
+{
+    static const gchar *const atom_names[] = {"Backlight", "BACKLIGHT"};
+    xcb_connection_t *connection = backlight->connection;
+    const xcb_query_extension_reply_t *extension_reply;
+    xcb_randr_query_version_reply_t *version_reply;
+    xcb_randr_get_screen_resources_current_reply_t *resources_reply;
+    xcb_randr_output_t *outputs;
+    xcb_generic_error_t *xcb_error = NULL;
+    gboolean found = FALSE;
+    guint i;
+    int j;
+
+    extension_reply = xcb_get_extension_data(connection, &xcb_randr_id);
+    if (!extension_reply || !extension_reply->present)
+        return FALSE;
+
+    version_reply = xcb_randr_query_version_reply(connection,
+                        xcb_randr_query_version(connection, 1, 3), &xcb_error);
+    if (!version_reply || (version_reply->major_version == 1
+                           && version_reply->minor_version < 3)) {
+        free(version_reply);
+        free(xcb_error);
+        return FALSE;
+    }
+    free(version_reply);
+
+    resources_reply = xcb_randr_get_screen_resources_current_reply(connection,
+                          xcb_randr_get_screen_resources_current(connection, root),
+                          &xcb_error);
+    if (!resources_reply) {
+        free(xcb_error);
+        return FALSE;
+    }
+    outputs = xcb_randr_get_screen_resources_current_outputs(resources_reply);
+
+    for (i = 0; !found && i < G_N_ELEMENTS(atom_names); i++) {
+        xcb_intern_atom_reply_t *atom_reply;
+
+        atom_reply = xcb_intern_atom_reply(connection,
+                         xcb_intern_atom(connection, TRUE, strlen(atom_names[i]),
+                                         atom_names[i]),
+                         &xcb_error);
+        free(xcb_error);
+        xcb_error = NULL;
+        if (!atom_reply)
+            continue;
+        backlight->atom = atom_reply->atom;
+        free(atom_reply);
+        if (backlight->atom == XCB_ATOM_NONE)
+            continue;
+
+        for (j = 0; !found
+                    && j < xcb_randr_get_screen_resources_current_outputs_length(resources_reply);
+             j++) {
+            xcb_randr_query_output_property_reply_t *property_reply;
+
+            property_reply = xcb_randr_query_output_property_reply(connection,
+                                 xcb_randr_query_output_property(connection, outputs[j],
+                                                                 backlight->atom),
+                                 &xcb_error);
+            free(xcb_error);
+            xcb_error = NULL;
+            if (property_reply && property_reply->range
+                && xcb_randr_query_output_property_valid_values_length(property_reply) == 2) {
+                int32_t *values = xcb_randr_query_output_property_valid_values(property_reply);
+
+                backlight->output = outputs[j];
+                backlight->minimum = values[0];
+                backlight->maximum = values[1];
+                found = TRUE;
+            }
+            free(property_reply);
+        }
+    }
+    free(resources_reply);
+    return found;
+}
+
+static gboolean
+sysfs_find_device(Backlight *backlight)
+{
+    GDir *dir = g_dir_open(BACKLIGHT_SYSFS_DIR, 0, NULL);
+    const gchar *name;
+
+    if (!dir)
+        return FALSE;
+
+    while (backlight->sysfs_fd < 0 && (name = g_dir_read_name(dir))) {
+        gchar *path = g_build_filename(BACKLIGHT_SYSFS_DIR, name,
+                                       "max_brightness", NULL);
+        gchar *contents = NULL;
+
+        if (g_file_get_contents(path, &contents, NULL, NULL)
+            && (backlight->maximum = g_ascii_strtoll(contents, NULL, 10)) > 0) {
+            g_free(path);
+            path = g_build_filename(BACKLIGHT_SYSFS_DIR, name, "brightness", NULL);
+            backlight->sysfs_fd = open(path, O_RDWR | O_CLOEXEC);
+        }
+        g_free(contents);
+        g_free(path);
+    }
+    g_dir_close(dir);
+    backlight->minimum = 0;
+    return backlight->sysfs_fd >= 0;
+}
+
+static gboolean
+backlight_get(Backlight *backlight, gint32 *level)
+{
+    if (backlight->sysfs_fd >= 0) {
+        gchar buffer[32];
+        ssize_t length = pread(backlight->sysfs_fd, buffer, sizeof buffer - 1, 0);
+
+        if (length <= 0)
+            return FALSE;
+        buffer[length] = '\0';
+        *level = g_ascii_strtoll(buffer, NULL, 10);
+        return TRUE;
+    } else {
+        xcb_randr_get_output_property_reply_t *property_reply;
+        xcb_generic_error_t *xcb_error = NULL;
+        gboolean success;
+
+        property_reply = xcb_randr_get_output_property_reply(backlight->connection,
+                             xcb_randr_get_output_property(backlight->connection,
+                                                           backlight->output,
+                                                           backlight->atom,
+                                                           XCB_ATOM_NONE, 0, 4,
+                                                           FALSE, FALSE),
+                             &xcb_error);
+        free(xcb_error);
+        success = property_reply && property_reply->type == XCB_ATOM_INTEGER
+                  && property_reply->format == 32
+                  && property_reply->num_items == 1;
+        if (success)
+            memcpy(level, xcb_randr_get_output_property_data(property_reply),
+                   sizeof *level);
+        free(property_reply);
+        return success;
+    }
+}
+
+static void
+backlight_set(Backlight *backlight, gint32 level)
+{
+    backlight->level = level;
+    if (backlight->sysfs_fd >= 0) {
+        gchar buffer[32];
+        gint length = g_snprintf(buffer, sizeof buffer, "%d", level);
+
+        if (pwrite(backlight->sysfs_fd, buffer, length, 0) < 0)
+            g_debug("Error writing backlight level: %s", g_strerror(errno));
+    } else {
+        xcb_randr_change_output_property(backlight->connection, backlight->output,
+                                         backlight->atom, XCB_ATOM_INTEGER, 32,
+                                         XCB_PROP_MODE_REPLACE, 1, &level);
+        xcb_flush(backlight->connection);
+    }
+}
+
+/* The fraction of the way from the minimum up to the saved level that is left
+ * at a given point of the fade; the exponential curve takes equal steps in
+ * perceived brightness.
+ */
+static gdouble
+curve_remaining(BacklightCurve curve, gdouble progress)
+{
+    switch (curve) {
+    case BACKLIGHT_CURVE_EASE:
+        return 1.0 - progress * progress * (3.0 - 2.0 * progress);
+    case BACKLIGHT_CURVE_EXPONENTIAL:
+        return (pow(BACKLIGHT_EXPONENTIAL_RANGE + 1.0, 1.0 - progress) - 1.0)
+               / BACKLIGHT_EXPONENTIAL_RANGE;
+    default:
+        return 1.0 - progress;
+    }
+}
+
+void
+backlight_fade(Backlight *backlight, guint duration, BacklightCurve curve)
+{
+    struct itimerspec frames = {
+        {0, BACKLIGHT_FRAME_INTERVAL * 1000},
+        {0, BACKLIGHT_FRAME_INTERVAL * 1000}
+    };
+
+    if (backlight->dimmed)
+        return;
+    if (!backlight_get(backlight, &backlight->saved)) {
+        g_warning("Error reading backlight level");
+        return;
+    }
+    backlight->saved = CLAMP(backlight->saved, backlight->minimum,
+                             backlight->maximum);
+    backlight->level = backlight->saved;
+    backlight->dimmed = TRUE;
+    backlight->curve = curve;
+    backlight->fade_start = g_get_monotonic_time();
+    backlight->fade_duration = (gint64)duration * 1000;
+
+    if (!duration || timerfd_settime(backlight->timer_fd, 0, &frames, NULL) < 0) {
+        backlight_set(backlight, backlight->minimum);
+        return;
+    }
+    stats_source_added();
+    backlight->timer_watch = g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+                                                backlight->timer_fd, G_IO_IN,
+                                                (GUnixFDSourceFunc)fade_step_cb,
+                                                backlight, stats_source_removed);
+}
+
+/* Each step is computed from the time elapsed, so frames the main loop misses
+ * are skipped rather than slowing the fade down.
+ */
+static gboolean
+fade_step_cb(gint fd, GIOCondition condition, Backlight *backlight)
+{
+    guint64 expirations;
+    gdouble progress;
+    gint32 level;
+
+    stats_count_wakeup(STATS_WAKEUP_TIMER);
+
+    if (read(fd, &expirations, sizeof expirations) < 0 && errno == EAGAIN)
+        return TRUE;
+
+    progress = MIN((gdouble)(g_get_monotonic_time() - backlight->fade_start)
+                   / backlight->fade_duration, 1.0);
+    level = backlight->minimum
+            + (gint32)lround((backlight->saved - backlight->minimum)
+                             * curve_remaining(backlight->curve, progress));
+    if (level != backlight->level)
+        backlight_set(backlight, level);
+    if (progress < 1.0)
+        return TRUE;
+
+    backlight->timer_watch = 0;
+    fade_stop(backlight);
+    return FALSE;
+}
+
+static void
+fade_stop(Backlight *backlight)
+{
+    struct itimerspec disarm = {{0, 0}, {0, 0}};
+
+    if (backlight->timer_watch) {
+        g_source_remove(backlight->timer_watch);
+        backlight->timer_watch = 0;
+    }
+    timerfd_settime(backlight->timer_fd, 0, &disarm, NULL);
+}
+
+/* Takes effect immediately: no further step is taken once this returns */
+void
+backlight_restore(Backlight *backlight)
+{
+    if (!backlight->dimmed)
+        return;
+    fade_stop(backlight);
+    backlight_set(backlight, backlight->saved);
+    backlight->dimmed = FALSE;
+}
@@ -0,0 +1,40 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef BACKLIGHT_H
+#define BACKLIGHT_H
+
+#include <glib.h>
+#include <xcb/xcb.h>
+
+G_BEGIN_DECLS
+
+#define BACKLIGHT_ERROR backlight_error_quark()
+
+/* How the level moves from its saved value down to the minimum */
+typedef enum {
+    BACKLIGHT_CURVE_LINEAR,
+    BACKLIGHT_CURVE_EASE,
+    BACKLIGHT_CURVE_EXPONENTIAL,
+    BACKLIGHT_N_CURVES
+} BacklightCurve;
+
+typedef struct Backlight Backlight;
+
+GQuark backlight_error_quark(void) G_GNUC_CONST;
+
+gboolean backlight_curve_from_string(const gchar *name, BacklightCurve *curve);
+
+Backlight *backlight_new(xcb_connection_t *connection, xcb_window_t root,
+                         GError **error);
+
+void backlight_free(Backlight *backlight);
+
+void backlight_fade(Backlight *backlight, guint duration, BacklightCurve curve);
+
+void backlight_restore(Backlight *backlight);
+
+G_END_DECLS
+
+#endif /* BACKLIGHT_H */
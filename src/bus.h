@@ -0,0 +1,56 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef BUS_H
+#define BUS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define BUS_ERROR bus_error_quark()
+
+/* The little of D-Bus that talking to logind takes, on the system bus. It is
+ * backed by GDBus, or with WITH_LEAN_DBUS by a built-in client on the main
+ * loop that needs neither GIO nor a thread.
+ *
+ * Errors are only lent to the callbacks; descriptors passed along with a
+ * reply are theirs to close.
+ */
+typedef struct Bus Bus;
+
+typedef void (*BusGetFunc)(Bus *bus, const GError *error, gpointer user_data);
+
+typedef void (*BusReplyFunc)(Bus *bus, GVariant *reply, gint fd,
+                             const GError *error, gpointer user_data);
+
+typedef void (*BusSignalFunc)(Bus *bus, const gchar *member,
+                              GVariant *parameters, gpointer user_data);
+
+GQuark bus_error_quark(void) G_GNUC_CONST;
+
+/* Signals are dispatched at priority, ahead of other work on the main loop */
+void bus_get_system(gint priority, BusGetFunc function, gpointer data);
+
+void bus_free(Bus *bus);
+
+guint bus_call(Bus *bus, const gchar *service, const gchar *path,
+               const gchar *interface, const gchar *method,
+               GVariant *parameters, const GVariantType *reply_type,
+               BusReplyFunc function, gpointer data);
+
+void bus_cancel(Bus *bus, guint call);
+
+/* Only signals sent by the current owner of service are passed on */
+guint bus_subscribe(Bus *bus, const gchar *service, const gchar *path,
+                    const gchar *interface, const gchar *member,
+                    BusSignalFunc function, gpointer data);
+
+void bus_unsubscribe(Bus *bus, guint subscription);
+
+gint64 bus_signal_arrival_time(Bus *bus);
+
+G_END_DECLS
+
+#endif /* BUS_H */
@@ -0,0 +1,507 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include "bus.h"
+#include "stats.h"
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BUS_DAEMON      "org.freedesktop.DBus"
+#define BUS_DAEMON_PATH "/org/freedesktop/DBus"
+
+typedef struct Dispatcher Dispatcher;
+
+struct Bus {
+    GDBusConnection *connection;
+    GHashTable      *calls;
+    guint            last_call;
+    Dispatcher      *dispatcher;
+    guint            filter;
+    GSList          *subscriptions;
+    guint            last_subscription;
+    GHashTable      *owners;
+    gint64           signal_arrival;
+};
+
+/* GDBus runs signal callbacks at default priority, so signals are taken from
+ * its worker thread instead and passed on to the main context at a priority
+ * of our own. Shared with that thread; only bus is touched from this one.
+ */
+struct Dispatcher {
+    volatile gint ref_count;
+    Bus          *bus;
+    GMainContext *context;
+    gint          priority;
+};
+
+typedef struct Delivery {
+    Dispatcher   *dispatcher;
+    GDBusMessage *message;
+    gint64        arrival;
+} Delivery;
+
+/* Outlives its cancellation, until GDBus is done with it */
+typedef struct Call {
+    Bus          *bus;
+    guint         id;
+    GCancellable *cancellable;
+    BusReplyFunc  function;
+    gpointer      data;
+} Call;
+
+typedef struct Subscription {
+    guint         id;
+    gchar        *rule;
+    gchar        *service;
+    gchar        *path;
+    gchar        *interface;
+    gchar        *member;
+    BusSignalFunc function;
+    gpointer      data;
+} Subscription;
+
+/* The unique name currently owning a well-known name that signals are
+ * subscribed from, followed through NameOwnerChanged
+ */
+typedef struct Owner {
+    gchar *name;
+    gchar *rule;
+    gchar *unique;
+    guint  users;
+    guint  call;
+} Owner;
+
+typedef struct GetClosure {
+    gint       priority;
+    BusGetFunc function;
+    gpointer   data;
+} GetClosure;
+
+static void bus_get_cb(GObject *source_object, GAsyncResult *res, gpointer user_data);
+static void call_cb(GObject *source_object, GAsyncResult *res, gpointer user_data);
+static GDBusMessage *filter_cb(GDBusConnection *connection, GDBusMessage *message, gboolean incoming, gpointer user_data);
+static gboolean deliver_cb(Delivery *delivery);
+static void delivery_free(Delivery *delivery);
+static Dispatcher *dispatcher_ref(Dispatcher *dispatcher);
+static void dispatcher_unref(Dispatcher *dispatcher);
+static void subscription_free(Subscription *subscription);
+static void owner_ref(Bus *bus, const gchar *name);
+static void owner_unref(Bus *bus, const gchar *name);
+static void get_name_owner_cb(Bus *bus, GVariant *reply, gint fd, const GError *error, gpointer user_data);
+static void name_owner_changed(Bus *bus, GVariant *parameters);
+static gboolean sent_by(Bus *bus, const gchar *service, const gchar *sender);
+static void owner_free(Owner *owner);
+
+GQuark
+bus_error_quark(void)
+{
+    return g_quark_from_static_string("bus-error-quark");
+}
+
+void
+bus_get_system(gint priority, BusGetFunc function, gpointer data)
+{
+    GetClosure *closure = g_new(GetClosure, 1);
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+    g_type_init();
+#endif
+    closure->priority = priority;
+    closure->function = function;
+    closure->data = data;
+    /* The connection is made by GDBus's worker thread meanwhile */
+    g_bus_get(G_BUS_TYPE_SYSTEM, NULL, bus_get_cb, closure);
+}
+
+static void
+bus_get_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+    GetClosure *closure = user_data;
+    GDBusConnection *connection;
+    GError *error = NULL;
+    Bus *bus = NULL;
+
+    if ((connection = g_bus_get_finish(res, &error))) {
+        bus = g_new0(Bus, 1);
+        bus->connection = connection;
+        bus->calls = g_hash_table_new(NULL, NULL);
+        bus->owners = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                            (GDestroyNotify)owner_free);
+        bus->dispatcher = g_new(Dispatcher, 1);
+        bus->dispatcher->ref_count = 1;
+        bus->dispatcher->bus = bus;
+        bus->dispatcher->context = g_main_context_ref_thread_default();
+        bus->dispatcher->priority = closure->priority;
+        bus->filter = g_dbus_connection_add_filter(
+                          connection, filter_cb,
+                          dispatcher_ref(bus->dispatcher),
+                          (GDestroyNotify)dispatcher_unref);
+    }
+    closure->function(bus, error, closure->data);
+    if (error)
+        g_error_free(error);
+    g_free(closure);
+}
+
+/* Calls still pending are cancelled and signals still queued dropped; they
+ * free themselves later.
+ */
+void
+bus_free(Bus *bus)
+{
+    GHashTableIter iter;
+    Call *call;
+
+    bus->dispatcher->bus = NULL;
+    g_dbus_connection_remove_filter(bus->connection, bus->filter);
+    dispatcher_unref(bus->dispatcher);
+    g_slist_free_full(bus->subscriptions, (GDestroyNotify)subscription_free);
+    g_hash_table_destroy(bus->owners);
+
+    g_hash_table_iter_init(&iter, bus->calls);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&call)) {
+        call->bus = NULL;
+        g_cancellable_cancel(call->cancellable);
+    }
+    g_hash_table_destroy(bus->calls);
+    g_object_unref(bus->connection);
+    g_free(bus);
+}
+
+guint
+bus_call(Bus *bus, const gchar *service, const gchar *path,
+         const gchar *interface, const gchar *method, GVariant *parameters,
+         const GVariantType *reply_type, BusReplyFunc function, gpointer data)
+{
+    Call *call;
+
+    if (!function) {
+        g_dbus_connection_call(bus->connection, service, path, interface,
+                               method, parameters, reply_type,
+                               G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+        return 0;
+    }
+
+    call = g_new(Call, 1);
+    call->bus = bus;
+    call->id = ++bus->last_call;
+    call->cancellable = g_cancellable_new();
+    call->function = function;
+    call->data = data;
+    g_hash_table_insert(bus->calls, GUINT_TO_POINTER(call->id), call);
+    g_dbus_connection_call_with_unix_fd_list(bus->connection, service, path,
+                                             interface, method, parameters,
+                                             reply_type, G_DBUS_CALL_FLAGS_NONE,
+                                             -1, NULL, call->cancellable,
+                                             call_cb, call);
+    return call->id;
+}
+
+void
+bus_cancel(Bus *bus, guint id)
+{
+    Call *call = g_hash_table_lookup(bus->calls, GUINT_TO_POINTER(id));
+
+    if (!call)
+        return;
+    g_hash_table_remove(bus->calls, GUINT_TO_POINTER(id));
+    call->bus = NULL;
+    g_cancellable_cancel(call->cancellable);
+}
+
+static void
+call_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+    Call *call = user_data;
+    GUnixFDList *fd_list = NULL;
+    GVariant *reply;
+    GError *error = NULL;
+    gint fd = -1;
+
+    reply = g_dbus_connection_call_with_unix_fd_list_finish(
+                G_DBUS_CONNECTION(source_object), &fd_list, res, &error);
+    if (fd_list) {
+        if (g_unix_fd_list_get_length(fd_list) > 0)
+            fd = g_unix_fd_list_get(fd_list, 0, NULL);
+        g_object_unref(fd_list);
+    }
+
+    if (call->bus) {
+        g_hash_table_remove(call->bus->calls, GUINT_TO_POINTER(call->id));
+        call->function(call->bus, reply, fd, error, call->data);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+
+    if (reply)
+        g_variant_unref(reply);
+    if (error)
+        g_error_free(error);
+    g_object_unref(call->cancellable);
+    g_free(call);
+}
+
+/* The bus daemon passes on unicast signals from any peer, whatever the match
+ * rule says; only those sent by the current owner of service are delivered,
+ * and none until that owner is known.
+ */
+guint
+bus_subscribe(Bus *bus, const gchar *service, const gchar *path,
+              const gchar *interface, const gchar *member,
+              BusSignalFunc function, gpointer data)
+{
+    Subscription *subscription = g_new(Subscription, 1);
+    GString *rule = g_string_new("type='signal'");
+
+    if (service)   g_string_append_printf(rule, ",sender='%s'", service);
+    if (path)      g_string_append_printf(rule, ",path='%s'", path);
+    if (interface) g_string_append_printf(rule, ",interface='%s'", interface);
+    if (member)    g_string_append_printf(rule, ",member='%s'", member);
+
+    subscription->id = ++bus->last_subscription;
+    subscription->rule = g_string_free(rule, FALSE);
+    subscription->service = g_strdup(service);
+    subscription->path = g_strdup(path);
+    subscription->interface = g_strdup(interface);
+    subscription->member = g_strdup(member);
+    subscription->function = function;
+    subscription->data = data;
+    bus->subscriptions = g_slist_prepend(bus->subscriptions, subscription);
+
+    bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON, "AddMatch",
+             g_variant_new("(s)", subscription->rule), NULL, NULL, NULL);
+    if (service && service[0] != ':')
+        owner_ref(bus, service);
+    return subscription->id;
+}
+
+void
+bus_unsubscribe(Bus *bus, guint id)
+{
+    GSList *link;
+
+    for (link = bus->subscriptions; link; link = link->next) {
+        Subscription *subscription = link->data;
+
+        if (subscription->id != id)
+            continue;
+        bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON, "RemoveMatch",
+                 g_variant_new("(s)", subscription->rule), NULL, NULL, NULL);
+        if (subscription->service && subscription->service[0] != ':')
+            owner_unref(bus, subscription->service);
+        bus->subscriptions = g_slist_delete_link(bus->subscriptions, link);
+        subscription_free(subscription);
+        return;
+    }
+}
+
+/* The match on NameOwnerChanged goes out before GetNameOwner, so that no
+ * change of owner in between is missed.
+ */
+static void
+owner_ref(Bus *bus, const gchar *name)
+{
+    Owner *owner = g_hash_table_lookup(bus->owners, name);
+
+    if (owner) {
+        owner->users++;
+        return;
+    }
+    owner = g_new0(Owner, 1);
+    owner->name = g_strdup(name);
+    owner->rule = g_strdup_printf("type='signal',sender='%s',path='%s',"
+                                  "interface='%s',member='NameOwnerChanged',"
+                                  "arg0='%s'", BUS_DAEMON, BUS_DAEMON_PATH,
+                                  BUS_DAEMON, name);
+    owner->users = 1;
+    g_hash_table_insert(bus->owners, owner->name, owner);
+
+    bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON, "AddMatch",
+             g_variant_new("(s)", owner->rule), NULL, NULL, NULL);
+    owner->call = bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON,
+                           "GetNameOwner", g_variant_new("(s)", name),
+                           G_VARIANT_TYPE("(s)"), get_name_owner_cb, owner);
+}
+
+static void
+owner_unref(Bus *bus, const gchar *name)
+{
+    Owner *owner = g_hash_table_lookup(bus->owners, name);
+
+    if (!owner || --owner->users)
+        return;
+    if (owner->call)
+        bus_cancel(bus, owner->call);
+    bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON, "RemoveMatch",
+             g_variant_new("(s)", owner->rule), NULL, NULL, NULL);
+    g_hash_table_remove(bus->owners, name);
+}
+
+/* Without an owner, the call fails and no signals are taken until one shows
+ * up.
+ */
+static void
+get_name_owner_cb(Bus *bus, GVariant *reply, gint fd, const GError *error,
+                  gpointer user_data)
+{
+    Owner *owner = user_data;
+
+    owner->call = 0;
+    if (reply)
+        g_variant_get(reply, "(s)", &owner->unique);
+}
+
+/* Newer than any GetNameOwner reply still on its way, which is dropped */
+static void
+name_owner_changed(Bus *bus, GVariant *parameters)
+{
+    const gchar *name, *new_owner;
+    Owner *owner;
+
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(sss)")))
+        return;
+    g_variant_get(parameters, "(&s&s&s)", &name, NULL, &new_owner);
+    if (!(owner = g_hash_table_lookup(bus->owners, name)))
+        return;
+    if (owner->call) {
+        bus_cancel(bus, owner->call);
+        owner->call = 0;
+    }
+    g_free(owner->unique);
+    owner->unique = *new_owner ? g_strdup(new_owner) : NULL;
+}
+
+/* Nobody else can own the bus daemon's name or a unique name */
+static gboolean
+sent_by(Bus *bus, const gchar *service, const gchar *sender)
+{
+    Owner *owner;
+
+    if (!service)
+        return TRUE;
+    if (service[0] == ':' || !strcmp(service, BUS_DAEMON))
+        return !g_strcmp0(service, sender);
+    owner = g_hash_table_lookup(bus->owners, service);
+    return owner && owner->unique && !g_strcmp0(owner->unique, sender);
+}
+
+/* Taken when the worker thread read the signal */
+gint64
+bus_signal_arrival_time(Bus *bus)
+{
+    return bus->signal_arrival;
+}
+
+/* Runs in GDBus's worker thread */
+static GDBusMessage *
+filter_cb(GDBusConnection *connection, GDBusMessage *message,
+          gboolean incoming, gpointer user_data)
+{
+    Dispatcher *dispatcher = user_data;
+    Delivery *delivery;
+
+    if (!incoming
+        || g_dbus_message_get_message_type(message) != G_DBUS_MESSAGE_TYPE_SIGNAL)
+        return message;
+
+    delivery = g_new(Delivery, 1);
+    delivery->dispatcher = dispatcher_ref(dispatcher);
+    delivery->message = g_object_ref(message);
+    delivery->arrival = g_get_monotonic_time();
+    stats_source_added();
+    g_main_context_invoke_full(dispatcher->context, dispatcher->priority,
+                               (GSourceFunc)deliver_cb, delivery,
+                               (GDestroyNotify)delivery_free);
+    return message;
+}
+
+/* A handler may unsubscribe others as well as itself */
+static gboolean
+deliver_cb(Delivery *delivery)
+{
+    Bus *bus = delivery->dispatcher->bus;
+    GDBusMessage *message = delivery->message;
+    const gchar *path = g_dbus_message_get_path(message);
+    const gchar *interface = g_dbus_message_get_interface(message);
+    const gchar *member = g_dbus_message_get_member(message);
+    const gchar *sender = g_dbus_message_get_sender(message);
+    GVariant *parameters = g_dbus_message_get_body(message);
+    GSList *subscriptions, *link;
+
+    if (!bus)
+        return FALSE;
+
+    /* Without arguments, there is no body at all */
+    parameters = parameters ? g_variant_ref(parameters)
+                            : g_variant_ref_sink(g_variant_new_tuple(NULL, 0));
+    if (!g_strcmp0(sender, BUS_DAEMON) && !g_strcmp0(interface, BUS_DAEMON)
+        && !g_strcmp0(member, "NameOwnerChanged"))
+        name_owner_changed(bus, parameters);
+
+    subscriptions = g_slist_copy(bus->subscriptions);
+    bus->signal_arrival = delivery->arrival;
+    for (link = subscriptions; link; link = link->next) {
+        Subscription *subscription = link->data;
+
+        if (!g_slist_find(bus->subscriptions, subscription)
+            || !sent_by(bus, subscription->service, sender)
+            || (subscription->path && g_strcmp0(subscription->path, path))
+            || (subscription->interface
+                && g_strcmp0(subscription->interface, interface))
+            || (subscription->member && g_strcmp0(subscription->member, member)))
+            continue;
+        subscription->function(bus, member, parameters, subscription->data);
+    }
+    bus->signal_arrival = 0;
+    g_slist_free(subscriptions);
+    g_variant_unref(parameters);
+    return FALSE;
+}
+
+static void
+delivery_free(Delivery *delivery)
+{
+    dispatcher_unref(delivery->dispatcher);
+    g_object_unref(delivery->message);
+    g_free(delivery);
+    stats_source_removed(NULL);
+}
+
+static Dispatcher *
+dispatcher_ref(Dispatcher *dispatcher)
+{
+    g_atomic_int_inc(&dispatcher->ref_count);
+    return dispatcher;
+}
+
+static void
+dispatcher_unref(Dispatcher *dispatcher)
+{
+    if (!g_atomic_int_dec_and_test(&dispatcher->ref_count))
+        return;
+    g_main_context_unref(dispatcher->context);
+    g_free(dispatcher);
+}
+
+static void
+subscription_free(Subscription *subscription)
+{
+    g_free(subscription->rule);
+    g_free(subscription->service);
+    g_free(subscription->path);
+    g_free(subscription->interface);
+    g_free(subscription->member);
+    g_free(subscription);
+}
+
+static void
+owner_free(Owner *owner)
+{
+    g_free(owner->name);
+    g_free(owner->rule);
+    g_free(owner->unique);
+    g_free(owner);
+}
@@ -0,0 +1,1206 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include "bus.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <glib-unix.h>
+
+/* Just enough of the D-Bus wire protocol for a client whose messages carry
+ * nothing but basic types: SASL EXTERNAL authentication (pipelined along
+ * with Hello, as sd-bus does), method calls, signals through match rules and
+ * descriptors passed with replies.
+ */
+#define BUS_DEFAULT_ADDRESS "unix:path=/var/run/dbus/system_bus_socket"
+#define BUS_DAEMON          "org.freedesktop.DBus"
+#define BUS_DAEMON_PATH     "/org/freedesktop/DBus"
+#define BUS_CALL_TIMEOUT    25          /* seconds, as with GDBus */
+#define BUS_MAX_MESSAGE     (1 << 27)   /* as in the specification */
+#define BUS_MAX_FDS         16          /* per read */
+#define BUS_READ_SIZE       4096
+#define BUS_MAX_AUTH        1024        /* bytes of authentication replies */
+
+enum {
+    MESSAGE_METHOD_CALL = 1,
+    MESSAGE_METHOD_RETURN,
+    MESSAGE_ERROR,
+    MESSAGE_SIGNAL
+};
+
+#define FLAG_NO_REPLY_EXPECTED 0x1
+
+enum {
+    FIELD_PATH = 1,
+    FIELD_INTERFACE,
+    FIELD_MEMBER,
+    FIELD_ERROR_NAME,
+    FIELD_REPLY_SERIAL,
+    FIELD_DESTINATION,
+    FIELD_SENDER,
+    FIELD_SIGNATURE,
+    FIELD_UNIX_FDS,
+    N_FIELDS
+};
+
+struct Bus {
+    gint        fd;
+    gint        priority;
+    guint       watch;
+    guint       out_watch;
+    GByteArray *in;
+    GByteArray *out;
+    GArray     *in_fds;
+    gint64      received;
+    gint64      signal_arrival;
+    gboolean    authenticated;
+    gboolean    ready;
+    gboolean    dead;
+    guint32     last_serial;
+    GHashTable *calls;
+    GSList     *subscriptions;
+    guint       last_subscription;
+    GHashTable *owners;
+    BusGetFunc  get_function;
+    gpointer    get_data;
+};
+
+/* Identified by its serial */
+typedef struct Call {
+    Bus          *bus;
+    guint32       serial;
+    GVariantType *reply_type;
+    guint         timeout;
+    BusReplyFunc  function;
+    gpointer      data;
+} Call;
+
+typedef struct Subscription {
+    guint         id;
+    gchar        *rule;
+    gchar        *service;
+    gchar        *path;
+    gchar        *interface;
+    gchar        *member;
+    BusSignalFunc function;
+    gpointer      data;
+} Subscription;
+
+/* The unique name currently owning a well-known name that signals are
+ * subscribed from, followed through NameOwnerChanged
+ */
+typedef struct Owner {
+    gchar *name;
+    gchar *rule;
+    gchar *unique;
+    guint  users;
+    guint  call;
+} Owner;
+
+typedef struct Message {
+    guint8       type;
+    guint8       flags;
+    guint32      serial;
+    guint32      reply_serial;
+    guint32      n_fds;
+    const gchar *fields[N_FIELDS];
+    GVariant    *body;
+} Message;
+
+typedef struct Reader {
+    const guint8 *data;
+    gsize         size;
+    gsize         pos;
+    gboolean      swap;
+} Reader;
+
+typedef struct GetFailure {
+    BusGetFunc function;
+    gpointer   data;
+    GError    *error;
+} GetFailure;
+
+static gint connect_address(const gchar *address, GError **error);
+static gboolean report_get_failure(GetFailure *failure);
+static void hello_cb(Bus *bus, GVariant *reply, gint fd, const GError *error, gpointer user_data);
+static gboolean free_dead_bus(Bus *bus);
+static guint32 send_message(Bus *bus, guint8 type, guint8 flags, guint32 reply_serial, const gchar *destination, const gchar *path, const gchar *interface, const gchar *member, const gchar *error_name, GVariant *parameters);
+static void flush(Bus *bus);
+static gboolean out_cb(gint fd, GIOCondition condition, Bus *bus);
+static gboolean in_cb(gint fd, GIOCondition condition, Bus *bus);
+static gboolean receive(Bus *bus);
+static gboolean read_auth(Bus *bus);
+static gboolean dispatch(Bus *bus, gboolean *done);
+static gboolean parse_message(Bus *bus, const guint8 *data, gsize size, Message *message);
+static void dispatch_reply(Bus *bus, Message *message, gint fd);
+static void dispatch_signal(Bus *bus, Message *message);
+static void disconnected(Bus *bus, const gchar *reason);
+static gboolean call_timeout_cb(Call *call);
+static void call_free(Call *call);
+static void subscription_free(Subscription *subscription);
+static void owner_ref(Bus *bus, const gchar *name);
+static void owner_unref(Bus *bus, const gchar *name);
+static void get_name_owner_cb(Bus *bus, GVariant *reply, gint fd, const GError *error, gpointer user_data);
+static void name_owner_changed(Bus *bus, GVariant *parameters);
+static gboolean sent_by(Bus *bus, const gchar *service, const gchar *sender);
+static void owner_free(Owner *owner);
+static void write_align(GByteArray *buffer, gsize alignment);
+static void write_u32(GByteArray *buffer, guint32 value);
+static void write_string(GByteArray *buffer, const gchar *value);
+static void write_signature(GByteArray *buffer, const gchar *value);
+static void write_field(GByteArray *buffer, guint8 code, gchar type, const gchar *value, guint32 number);
+static gboolean write_basic(GByteArray *buffer, GVariant *value);
+static gboolean read_align(Reader *reader, gsize alignment);
+static gboolean read_fixed(Reader *reader, gsize size, gpointer value);
+static gboolean read_string(Reader *reader, gboolean signature, const gchar **value);
+static GVariant *read_basic(Reader *reader, gchar type);
+
+GQuark
+bus_error_quark(void)
+{
+    return g_quark_from_static_string("bus-error-quark");
+}
+
+/* The connection is set up on the main loop; function is called once the
+ * bus has answered Hello. Replies come in at the same priority as signals,
+ * as they share the socket.
+ */
+void
+bus_get_system(gint priority, BusGetFunc function, gpointer data)
+{
+    const gchar *address = g_getenv("DBUS_SYSTEM_BUS_ADDRESS");
+    GError *error = NULL;
+    gchar *uid, *c;
+    Bus *bus;
+    gint fd;
+
+    if ((fd = connect_address(address ? address : BUS_DEFAULT_ADDRESS,
+                              &error)) < 0) {
+        GetFailure *failure = g_new(GetFailure, 1);
+
+        failure->function = function;
+        failure->data = data;
+        failure->error = error;
+        stats_source_added();
+        g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
+                        (GSourceFunc)report_get_failure, failure,
+                        stats_source_removed);
+        return;
+    }
+
+    bus = g_new0(Bus, 1);
+    bus->fd = fd;
+    bus->priority = priority;
+    bus->in = g_byte_array_new();
+    bus->out = g_byte_array_new();
+    bus->in_fds = g_array_new(FALSE, FALSE, sizeof(gint));
+    bus->calls = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)call_free);
+    bus->owners = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                        (GDestroyNotify)owner_free);
+    bus->get_function = function;
+    bus->get_data = data;
+
+    /* The identity is the UID in decimal, hex-encoded */
+    uid = g_strdup_printf("%u", (guint)getuid());
+    g_byte_array_append(bus->out, (const guint8 *)"", 1);
+    g_byte_array_append(bus->out, (const guint8 *)"AUTH EXTERNAL ", 14);
+    for (c = uid; *c; c++) {
+        gchar hex[3];
+
+        g_snprintf(hex, sizeof(hex), "%02x", (guint8)*c);
+        g_byte_array_append(bus->out, (const guint8 *)hex, 2);
+    }
+    g_free(uid);
+    g_byte_array_append(bus->out, (const guint8 *)"\r\nNEGOTIATE_UNIX_FD\r\nBEGIN\r\n", 28);
+
+    stats_source_added();
+    bus->watch = g_unix_fd_add_full(priority, fd, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                    (GUnixFDSourceFunc)in_cb, bus,
+                                    stats_source_removed);
+    bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON, "Hello", NULL,
+             G_VARIANT_TYPE("(s)"), hello_cb, NULL);
+}
+
+/* Takes the first unix: address of a semicolon-separated list that works */
+static gint
+connect_address(const gchar *address, GError **error)
+{
+    gchar **entries = g_strsplit(address, ";", -1), **entry;
+    gint fd = -1;
+
+    for (entry = entries; *entry && fd < 0; entry++) {
+        struct sockaddr_un sockaddr = {AF_UNIX};
+        socklen_t length = 0;
+        gchar **pairs, **pair;
+
+        if (!g_str_has_prefix(*entry, "unix:"))
+            continue;
+        pairs = g_strsplit(*entry + strlen("unix:"), ",", -1);
+        for (pair = pairs; *pair && !length; pair++) {
+            gchar *value;
+            gsize offset;
+
+            if (g_str_has_prefix(*pair, "path="))
+                offset = 0;
+            else if (g_str_has_prefix(*pair, "abstract="))
+                offset = 1;
+            else
+                continue;
+            value = g_uri_unescape_string(strchr(*pair, '=') + 1, NULL);
+            if (value && strlen(value) + offset < sizeof(sockaddr.sun_path)) {
+                memcpy(sockaddr.sun_path + offset, value, strlen(value));
+                length = offsetof(struct sockaddr_un, sun_path)
+                         + offset + strlen(value) + !offset;
+            }
+            g_free(value);
+        }
+        g_strfreev(pairs);
+        if (!length)
+            continue;
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&sockaddr, length) < 0) {
+            g_set_error(error, BUS_ERROR, 0, "Error connecting to %s: %s",
+                        *entry, g_strerror(errno));
+            close(fd);
+            fd = -1;
+        }
+    }
+    g_strfreev(entries);
+
+    if (fd < 0) {
+        if (error && !*error)
+            g_set_error(error, BUS_ERROR, 0, "No usable address in %s", address);
+        return -1;
+    }
+    g_clear_error(error);
+    g_unix_set_fd_nonblocking(fd, TRUE, NULL);
+    return fd;
+}
+
+static gboolean
+report_get_failure(GetFailure *failure)
+{
+    failure->function(NULL, failure->error, failure->data);
+    g_error_free(failure->error);
+    g_free(failure);
+    return FALSE;
+}
+
+static void
+hello_cb(Bus *bus, GVariant *reply, gint fd, const GError *error,
+         gpointer user_data)
+{
+    if (error) {
+        bus->dead = TRUE;
+        bus->get_function(NULL, error, bus->get_data);
+        stats_source_added();
+        g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, (GSourceFunc)free_dead_bus,
+                        bus, stats_source_removed);
+        return;
+    }
+    bus->ready = TRUE;
+    bus->get_function(bus, NULL, bus->get_data);
+}
+
+static gboolean
+free_dead_bus(Bus *bus)
+{
+    bus_free(bus);
+    return FALSE;
+}
+
+void
+bus_free(Bus *bus)
+{
+    guint i;
+
+    if (bus->watch) g_source_remove(bus->watch);
+    if (bus->out_watch) g_source_remove(bus->out_watch);
+    if (bus->fd >= 0) close(bus->fd);
+    for (i = 0; i < bus->in_fds->len; i++)
+        close(g_array_index(bus->in_fds, gint, i));
+    g_array_free(bus->in_fds, TRUE);
+    g_byte_array_free(bus->in, TRUE);
+    g_byte_array_free(bus->out, TRUE);
+    g_hash_table_destroy(bus->calls);
+    g_slist_free_full(bus->subscriptions, (GDestroyNotify)subscription_free);
+    g_hash_table_destroy(bus->owners);
+    g_free(bus);
+}
+
+/* Without a function, no reply is asked for. Calls are identified by
+ * their serial.
+ */
+guint
+bus_call(Bus *bus, const gchar *service, const gchar *path,
+         const gchar *interface, const gchar *method, GVariant *parameters,
+         const GVariantType *reply_type, BusReplyFunc function, gpointer data)
+{
+    Call *call;
+    guint32 serial;
+
+    serial = send_message(bus, MESSAGE_METHOD_CALL,
+                          function ? 0 : FLAG_NO_REPLY_EXPECTED, 0, service,
+                          path, interface, method, NULL, parameters);
+    if (!function || !serial)
+        return 0;
+
+    call = g_new(Call, 1);
+    call->bus = bus;
+    call->serial = serial;
+    call->reply_type = reply_type ? g_variant_type_copy(reply_type) : NULL;
+    stats_source_added();
+    call->timeout = g_timeout_add_seconds_full(G_PRIORITY_DEFAULT,
+                                               BUS_CALL_TIMEOUT,
+                                               (GSourceFunc)call_timeout_cb,
+                                               call, stats_source_removed);
+    call->function = function;
+    call->data = data;
+    g_hash_table_insert(bus->calls, GUINT_TO_POINTER(serial), call);
+    return serial;
+}
+
+void
+bus_cancel(Bus *bus, guint call)
+{
+    g_hash_table_remove(bus->calls, GUINT_TO_POINTER(call));
+}
+
+/* The bus daemon passes on unicast signals from any peer, whatever the match
+ * rule says; only those sent by the current owner of service are delivered,
+ * and none until that owner is known.
+ */
+guint
+bus_subscribe(Bus *bus, const gchar *service, const gchar *path,
+              const gchar *interface, const gchar *member,
+              BusSignalFunc function, gpointer data)
+{
+    Subscription *subscription = g_new(Subscription, 1);
+    GString *rule = g_string_new("type='signal'");
+
+    if (service)   g_string_append_printf(rule, ",sender='%s'", service);
+    if (path)      g_string_append_printf(rule, ",path='%s'", path);
+    if (interface) g_string_append_printf(rule, ",interface='%s'", interface);
+    if (member)    g_string_append_printf(rule, ",member='%s'", member);
+
+    subscription->id = ++bus->last_subscription;
+    subscription->rule = g_string_free(rule, FALSE);
+    subscription->service = g_strdup(service);
+    subscription->path = g_strdup(path);
+    subscription->interface = g_strdup(interface);
+    subscription->member = g_strdup(member);
+    subscription->function = function;
+    subscription->data = data;
+    bus->subscriptions = g_slist_prepend(bus->subscriptions, subscription);
+
+    bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON, "AddMatch",
+             g_variant_new("(s)", subscription->rule), NULL, NULL, NULL);
+    if (service && service[0] != ':')
+        owner_ref(bus, service);
+    return subscription->id;
+}
+
+void
+bus_unsubscribe(Bus *bus, guint id)
+{
+    GSList *link;
+
+    for (link = bus->subscriptions; link; link = link->next) {
+        Subscription *subscription = link->data;
+
+        if (subscription->id != id)
+            continue;
+        bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON, "RemoveMatch",
+                 g_variant_new("(s)", subscription->rule), NULL, NULL, NULL);
+        if (subscription->service && subscription->service[0] != ':')
+            owner_unref(bus, subscription->service);
+        bus->subscriptions = g_slist_delete_link(bus->subscriptions, link);
+        subscription_free(subscription);
+        return;
+    }
+}
+
+/* The match on NameOwnerChanged goes out before GetNameOwner, so that no
+ * change of owner in between is missed.
+ */
+static void
+owner_ref(Bus *bus, const gchar *name)
+{
+    Owner *owner = g_hash_table_lookup(bus->owners, name);
+
+    if (owner) {
+        owner->users++;
+        return;
+    }
+    owner = g_new0(Owner, 1);
+    owner->name = g_strdup(name);
+    owner->rule = g_strdup_printf("type='signal',sender='%s',path='%s',"
+                                  "interface='%s',member='NameOwnerChanged',"
+                                  "arg0='%s'", BUS_DAEMON, BUS_DAEMON_PATH,
+                                  BUS_DAEMON, name);
+    owner->users = 1;
+    g_hash_table_insert(bus->owners, owner->name, owner);
+
+    bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON, "AddMatch",
+             g_variant_new("(s)", owner->rule), NULL, NULL, NULL);
+    owner->call = bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON,
+                           "GetNameOwner", g_variant_new("(s)", name),
+                           G_VARIANT_TYPE("(s)"), get_name_owner_cb, owner);
+}
+
+static void
+owner_unref(Bus *bus, const gchar *name)
+{
+    Owner *owner = g_hash_table_lookup(bus->owners, name);
+
+    if (!owner || --owner->users)
+        return;
+    if (owner->call)
+        bus_cancel(bus, owner->call);
+    bus_call(bus, BUS_DAEMON, BUS_DAEMON_PATH, BUS_DAEMON, "RemoveMatch",
+             g_variant_new("(s)", owner->rule), NULL, NULL, NULL);
+    g_hash_table_remove(bus->owners, name);
+}
+
+/* Without an owner, the call fails and no signals are taken until one shows
+ * up.
+ */
+static void
+get_name_owner_cb(Bus *bus, GVariant *reply, gint fd, const GError *error,
+                  gpointer user_data)
+{
+    Owner *owner = user_data;
+
+    owner->call = 0;
+    if (reply)
+        g_variant_get(reply, "(s)", &owner->unique);
+}
+
+/* Replies come in order with signals here, so the reply still pending can
+ * only repeat what the signal says.
+ */
+static void
+name_owner_changed(Bus *bus, GVariant *parameters)
+{
+    const gchar *name, *new_owner;
+    Owner *owner;
+
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(sss)")))
+        return;
+    g_variant_get(parameters, "(&s&s&s)", &name, NULL, &new_owner);
+    if (!(owner = g_hash_table_lookup(bus->owners, name)))
+        return;
+    if (owner->call) {
+        bus_cancel(bus, owner->call);
+        owner->call = 0;
+    }
+    g_free(owner->unique);
+    owner->unique = *new_owner ? g_strdup(new_owner) : NULL;
+}
+
+/* Nobody else can own the bus daemon's name or a unique name */
+static gboolean
+sent_by(Bus *bus, const gchar *service, const gchar *sender)
+{
+    Owner *owner;
+
+    if (!service)
+        return TRUE;
+    if (service[0] == ':' || !strcmp(service, BUS_DAEMON))
+        return !g_strcmp0(service, sender);
+    owner = g_hash_table_lookup(bus->owners, service);
+    return owner && owner->unique && !g_strcmp0(owner->unique, sender);
+}
+
+/* A signal counts as received once the last of it has been read */
+gint64
+bus_signal_arrival_time(Bus *bus)
+{
+    return bus->signal_arrival;
+}
+
+/* Messages go out in native byte order; parameters must be a tuple of basic
+ * types. Returns the serial, or 0 if the parameters could not be encoded.
+ */
+static guint32
+send_message(Bus *bus, guint8 type, guint8 flags, guint32 reply_serial,
+             const gchar *destination, const gchar *path,
+             const gchar *interface, const gchar *member,
+             const gchar *error_name, GVariant *parameters)
+{
+    GByteArray *message, *body = g_byte_array_new();
+    gchar *signature = NULL;
+    guint8 start[4] = {G_BYTE_ORDER == G_LITTLE_ENDIAN ? 'l' : 'B', type, flags, 1};
+    guint32 fields_length;
+    gsize i;
+
+    if (parameters) {
+        const gchar *tuple;
+
+        g_variant_ref_sink(parameters);
+        tuple = g_variant_get_type_string(parameters);
+        if (g_variant_is_of_type(parameters, G_VARIANT_TYPE_TUPLE))
+            signature = g_strndup(tuple + 1, strlen(tuple) - 2);
+        for (i = 0; signature && i < g_variant_n_children(parameters); i++) {
+            GVariant *child = g_variant_get_child_value(parameters, i);
+
+            if (!write_basic(body, child)) {
+                g_free(signature);
+                signature = NULL;
+            }
+            g_variant_unref(child);
+        }
+        g_variant_unref(parameters);
+        if (!signature) {
+            g_critical("Cannot send %s parameters of type %s", member, tuple);
+            g_byte_array_free(body, TRUE);
+            return 0;
+        }
+    }
+
+    message = g_byte_array_sized_new(128 + body->len);
+    g_byte_array_append(message, start, sizeof(start));
+    write_u32(message, body->len);
+    write_u32(message, ++bus->last_serial);
+    write_u32(message, 0);
+    if (path)         write_field(message, FIELD_PATH, 'o', path, 0);
+    if (interface)    write_field(message, FIELD_INTERFACE, 's', interface, 0);
+    if (member)       write_field(message, FIELD_MEMBER, 's', member, 0);
+    if (error_name)   write_field(message, FIELD_ERROR_NAME, 's', error_name, 0);
+    if (reply_serial) write_field(message, FIELD_REPLY_SERIAL, 'u', NULL, reply_serial);
+    if (destination)  write_field(message, FIELD_DESTINATION, 's', destination, 0);
+    if (signature && *signature)
+        write_field(message, FIELD_SIGNATURE, 'g', signature, 0);
+    fields_length = message->len - 16;
+    memcpy(message->data + 12, &fields_length, 4);
+    write_align(message, 8);
+    g_byte_array_append(message, body->data, body->len);
+
+    g_byte_array_append(bus->out, message->data, message->len);
+    g_byte_array_free(message, TRUE);
+    g_byte_array_free(body, TRUE);
+    g_free(signature);
+    flush(bus);
+    return bus->last_serial;
+}
+
+/* A write error is left for the read side to notice. The watch for
+ * writability stays until out_cb() finds nothing left to write.
+ */
+static void
+flush(Bus *bus)
+{
+    while (bus->out->len) {
+        gssize written = send(bus->fd, bus->out->data, bus->out->len,
+                              MSG_NOSIGNAL);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0 && errno == EAGAIN) {
+            if (!bus->out_watch) {
+                stats_source_added();
+                bus->out_watch = g_unix_fd_add_full(bus->priority, bus->fd,
+                                                    G_IO_OUT,
+                                                    (GUnixFDSourceFunc)out_cb,
+                                                    bus, stats_source_removed);
+            }
+            return;
+        }
+        if (written < 0) {
+            g_byte_array_set_size(bus->out, 0);
+            break;
+        }
+        g_byte_array_remove_range(bus->out, 0, written);
+    }
+}
+
+static gboolean
+out_cb(gint fd, GIOCondition condition, Bus *bus)
+{
+    flush(bus);
+    if (bus->out->len)
+        return TRUE;
+    bus->out_watch = 0;
+    return FALSE;
+}
+
+static gboolean
+in_cb(gint fd, GIOCondition condition, Bus *bus)
+{
+    gboolean done = FALSE;
+
+    if (bus->dead) {
+        bus->watch = 0;
+        return FALSE;
+    }
+    if (!receive(bus)) {
+        bus->watch = 0;
+        disconnected(bus, "connection closed");
+        return FALSE;
+    }
+    if (!bus->authenticated && !read_auth(bus)) {
+        bus->watch = 0;
+        disconnected(bus, "authentication failed");
+        return FALSE;
+    }
+    while (bus->authenticated && !done && !bus->dead) {
+        if (!dispatch(bus, &done)) {
+            bus->watch = 0;
+            disconnected(bus, "protocol error");
+            return FALSE;
+        }
+    }
+    if (bus->dead) {
+        bus->watch = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean
+receive(Bus *bus)
+{
+    union {
+        struct cmsghdr header;
+        gchar buffer[CMSG_SPACE(BUS_MAX_FDS * sizeof(gint))];
+    } control;
+    guint8 buffer[BUS_READ_SIZE];
+    struct iovec iov = {buffer, sizeof(buffer)};
+    struct msghdr msg = {NULL, 0, &iov, 1, &control, sizeof(control), 0};
+    struct cmsghdr *cmsg;
+    gssize length;
+
+    do
+        length = recvmsg(bus->fd, &msg, MSG_CMSG_CLOEXEC);
+    while (length < 0 && errno == EINTR);
+    if (length < 0 && errno == EAGAIN)
+        return TRUE;
+    if (length <= 0)
+        return FALSE;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            g_array_append_vals(bus->in_fds, CMSG_DATA(cmsg),
+                                (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(gint));
+    g_byte_array_append(bus->in, buffer, length);
+    bus->received = g_get_monotonic_time();
+    return !(msg.msg_flags & MSG_CTRUNC);
+}
+
+/* Replies to the pipelined commands: OK, then AGREE_UNIX_FD or ERROR */
+static gboolean
+read_auth(Bus *bus)
+{
+    const gchar *data = (const gchar *)bus->in->data;
+    guint lines = 0;
+    gsize i, start = 0;
+
+    for (i = 0; i + 1 < bus->in->len && lines < 2; i++) {
+        if (data[i] != '\r' || data[i + 1] != '\n')
+            continue;
+        if (lines == 0 && strncmp(data + start, "OK ", 3))
+            return FALSE;
+        lines++;
+        start = i + 2;
+        i++;
+    }
+    if (lines < 2)
+        return bus->in->len < BUS_MAX_AUTH;
+
+    g_byte_array_remove_range(bus->in, 0, start);
+    bus->authenticated = TRUE;
+    return TRUE;
+}
+
+/* Handles one complete message, if there is one; done tells if there was not */
+static gboolean
+dispatch(Bus *bus, gboolean *done)
+{
+    Message message;
+    guint32 body_length, fields_length;
+    gsize size;
+    gint fd = -1;
+    guint i;
+
+    if (bus->in->len < 16) {
+        *done = TRUE;
+        return TRUE;
+    }
+    memcpy(&body_length, bus->in->data + 4, 4);
+    memcpy(&fields_length, bus->in->data + 12, 4);
+    if (bus->in->data[0] != (G_BYTE_ORDER == G_LITTLE_ENDIAN ? 'l' : 'B')) {
+        body_length = GUINT32_SWAP_LE_BE(body_length);
+        fields_length = GUINT32_SWAP_LE_BE(fields_length);
+    }
+    if ((guint64)fields_length + body_length > BUS_MAX_MESSAGE)
+        return FALSE;
+    size = 16 + ((fields_length + 7) & ~7) + body_length;
+    if (bus->in->len < size) {
+        *done = TRUE;
+        return TRUE;
+    }
+
+    if (!parse_message(bus, bus->in->data, size, &message)
+        || message.n_fds > bus->in_fds->len)
+        return FALSE;
+    for (i = 0; i < message.n_fds; i++) {
+        gint passed = g_array_index(bus->in_fds, gint, i);
+
+        if (fd < 0) fd = passed;
+        else close(passed);
+    }
+    g_array_remove_range(bus->in_fds, 0, message.n_fds);
+
+    switch (message.type) {
+    case MESSAGE_METHOD_RETURN:
+    case MESSAGE_ERROR:
+        dispatch_reply(bus, &message, fd);
+        fd = -1;
+        break;
+    case MESSAGE_SIGNAL:
+        dispatch_signal(bus, &message);
+        break;
+    case MESSAGE_METHOD_CALL:
+        if (!(message.flags & FLAG_NO_REPLY_EXPECTED) && message.fields[FIELD_SENDER])
+            send_message(bus, MESSAGE_ERROR, FLAG_NO_REPLY_EXPECTED,
+                         message.serial, message.fields[FIELD_SENDER], NULL,
+                         NULL, NULL, "org.freedesktop.DBus.Error.UnknownMethod",
+                         g_variant_new("(s)", "No methods here"));
+        break;
+    }
+    if (fd >= 0)
+        close(fd);
+    if (message.body)
+        g_variant_unref(message.body);
+    g_byte_array_remove_range(bus->in, 0, size);
+    return TRUE;
+}
+
+/* The string fields point into data, which has to stay put until the
+ * message is handled. A body that is not a tuple of basic types is left out.
+ */
+static gboolean
+parse_message(Bus *bus, const guint8 *data, gsize size, Message *message)
+{
+    Reader reader = {data, size, 12, data[0] == 'B' ? G_BYTE_ORDER == G_LITTLE_ENDIAN
+                                                    : G_BYTE_ORDER == G_BIG_ENDIAN};
+    guint32 fields_length;
+    gsize fields_end;
+    GPtrArray *children;
+    const gchar *signature;
+
+    memset(message, 0, sizeof(*message));
+    if ((data[0] != 'l' && data[0] != 'B') || data[3] != 1)
+        return FALSE;
+    message->type = data[1];
+    message->flags = data[2];
+    memcpy(&message->serial, data + 8, 4);
+    if (reader.swap)
+        message->serial = GUINT32_SWAP_LE_BE(message->serial);
+
+    read_fixed(&reader, 4, &fields_length);
+    fields_end = 16 + fields_length;
+    while (reader.pos < fields_end) {
+        guint8 code;
+        const gchar *type, *value = NULL;
+        guint32 number = 0;
+
+        if (!read_align(&reader, 8) || !read_fixed(&reader, 1, &code)
+            || !read_string(&reader, TRUE, &type) || strlen(type) != 1)
+            return FALSE;
+        if (*type == 'u') {
+            if (!read_fixed(&reader, 4, &number))
+                return FALSE;
+        } else if (*type == 's' || *type == 'o' || *type == 'g') {
+            if (!read_string(&reader, *type == 'g', &value))
+                return FALSE;
+        } else {
+            GVariant *skipped = read_basic(&reader, *type);
+
+            if (!skipped)
+                return FALSE;
+            g_variant_unref(g_variant_ref_sink(skipped));
+        }
+
+        if (code == FIELD_REPLY_SERIAL)
+            message->reply_serial = number;
+        else if (code == FIELD_UNIX_FDS)
+            message->n_fds = number;
+        else if (code < N_FIELDS && value)
+            message->fields[code] = value;
+    }
+    if (reader.pos != fields_end)
+        return FALSE;
+
+    reader.pos = (fields_end + 7) & ~7;
+    children = g_ptr_array_new();
+    for (signature = message->fields[FIELD_SIGNATURE];
+         signature && *signature; signature++) {
+        GVariant *child = read_basic(&reader, *signature);
+
+        if (!child)
+            break;
+        g_ptr_array_add(children, g_variant_ref_sink(child));
+    }
+    if (!signature || !*signature)
+        message->body = g_variant_ref_sink(
+            g_variant_new_tuple((GVariant **)children->pdata, children->len));
+    g_ptr_array_foreach(children, (GFunc)g_variant_unref, NULL);
+    g_ptr_array_free(children, TRUE);
+    return TRUE;
+}
+
+static void
+dispatch_reply(Bus *bus, Message *message, gint fd)
+{
+    Call *call;
+    GError *error = NULL;
+    gpointer key;
+
+    if (!g_hash_table_lookup_extended(bus->calls,
+                                      GUINT_TO_POINTER(message->reply_serial),
+                                      &key, (gpointer *)&call)) {
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    g_hash_table_steal(bus->calls, key);
+
+    if (message->type == MESSAGE_ERROR) {
+        GVariant *text = message->body && g_variant_n_children(message->body)
+                         ? g_variant_get_child_value(message->body, 0) : NULL;
+
+        g_set_error(&error, BUS_ERROR, 0, "%s: %s",
+                    message->fields[FIELD_ERROR_NAME]
+                    ? message->fields[FIELD_ERROR_NAME] : "Error",
+                    text && g_variant_is_of_type(text, G_VARIANT_TYPE_STRING)
+                    ? g_variant_get_string(text, NULL) : "");
+        if (text)
+            g_variant_unref(text);
+    } else if (!message->body
+               || (call->reply_type
+                   && !g_variant_is_of_type(message->body, call->reply_type))) {
+        g_set_error(&error, BUS_ERROR, 0, "Unexpected reply type %s",
+                    message->fields[FIELD_SIGNATURE]
+                    ? message->fields[FIELD_SIGNATURE] : "");
+    }
+
+    if (error && fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    call->function(bus, error ? NULL : message->body, fd, error, call->data);
+    if (error)
+        g_error_free(error);
+    call_free(call);
+}
+
+/* A handler may unsubscribe others as well as itself */
+static void
+dispatch_signal(Bus *bus, Message *message)
+{
+    const gchar *path = message->fields[FIELD_PATH];
+    const gchar *interface = message->fields[FIELD_INTERFACE];
+    const gchar *member = message->fields[FIELD_MEMBER];
+    const gchar *sender = message->fields[FIELD_SENDER];
+    GSList *subscriptions, *link;
+
+    if (message->body && !g_strcmp0(sender, BUS_DAEMON)
+        && !g_strcmp0(interface, BUS_DAEMON)
+        && !g_strcmp0(member, "NameOwnerChanged"))
+        name_owner_changed(bus, message->body);
+
+    subscriptions = g_slist_copy(bus->subscriptions);
+    bus->signal_arrival = bus->received;
+    for (link = subscriptions; link && message->body; link = link->next) {
+        Subscription *subscription = link->data;
+
+        if (!g_slist_find(bus->subscriptions, subscription)
+            || !sent_by(bus, subscription->service, sender)
+            || (subscription->path && g_strcmp0(subscription->path, path))
+            || (subscription->interface
+                && g_strcmp0(subscription->interface, interface))
+            || (subscription->member && g_strcmp0(subscription->member, member)))
+            continue;
+        subscription->function(bus, member, message->body, subscription->data);
+    }
+    bus->signal_arrival = 0;
+    g_slist_free(subscriptions);
+}
+
+/* Pending calls fail. Like a GDBus connection to the system bus, losing it
+ * once up terminates the process; before that, whoever asked for the bus
+ * hears about it from hello_cb().
+ */
+static void
+disconnected(Bus *bus, const gchar *reason)
+{
+    GHashTable *calls = bus->calls;
+    GHashTableIter iter;
+    GError *error = NULL;
+    Call *call;
+
+    bus->calls = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)call_free);
+    g_set_error(&error, BUS_ERROR, 0, "System bus %s", reason);
+    g_hash_table_iter_init(&iter, calls);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&call))
+        call->function(bus, NULL, -1, error, call->data);
+    g_hash_table_destroy(calls);
+
+    if (bus->ready) {
+        g_warning("%s", error->message);
+        raise(SIGTERM);
+    }
+    g_error_free(error);
+}
+
+static gboolean
+call_timeout_cb(Call *call)
+{
+    Bus *bus = call->bus;
+    GError *error = NULL;
+
+    call->timeout = 0;
+    g_hash_table_steal(bus->calls, GUINT_TO_POINTER(call->serial));
+    g_set_error(&error, BUS_ERROR, 0, "Timed out waiting for a reply");
+    call->function(bus, NULL, -1, error, call->data);
+    g_error_free(error);
+    call_free(call);
+    return FALSE;
+}
+
+static void
+call_free(Call *call)
+{
+    if (call->timeout) g_source_remove(call->timeout);
+    if (call->reply_type) g_variant_type_free(call->reply_type);
+    g_free(call);
+}
+
+static void
+subscription_free(Subscription *subscription)
+{
+    g_free(subscription->rule);
+    g_free(subscription->service);
+    g_free(subscription->path);
+    g_free(subscription->interface);
+    g_free(subscription->member);
+    g_free(subscription);
+}
+
+static void
+owner_free(Owner *owner)
+{
+    g_free(owner->name);
+    g_free(owner->rule);
+    g_free(owner->unique);
+    g_free(owner);
+}
+
+/* Alignment is relative to the start of the buffer, which is where the
+ * message or its (8-aligned) body starts.
+ */
+static void
+write_align(GByteArray *buffer, gsize alignment)
+{
+    static const guint8 padding[8];
+
+    g_byte_array_append(buffer, padding,
+                        (alignment - buffer->len % alignment) % alignment);
+}
+
+static void
+write_u32(GByteArray *buffer, guint32 value)
+{
+    write_align(buffer, 4);
+    g_byte_array_append(buffer, (const guint8 *)&value, 4);
+}
+
+static void
+write_string(GByteArray *buffer, const gchar *value)
+{
+    write_u32(buffer, strlen(value));
+    g_byte_array_append(buffer, (const guint8 *)value, strlen(value) + 1);
+}
+
+static void
+write_signature(GByteArray *buffer, const gchar *value)
+{
+    guint8 length = strlen(value);
+
+    g_byte_array_append(buffer, &length, 1);
+    g_byte_array_append(buffer, (const guint8 *)value, length + 1);
+}
+
+static void
+write_field(GByteArray *buffer, guint8 code, gchar type, const gchar *value,
+            guint32 number)
+{
+    gchar signature[2] = {type, '\0'};
+
+    write_align(buffer, 8);
+    g_byte_array_append(buffer, &code, 1);
+    write_signature(buffer, signature);
+    if (type == 'u')
+        write_u32(buffer, number);
+    else if (type == 'g')
+        write_signature(buffer, value);
+    else
+        write_string(buffer, value);
+}
+
+static gboolean
+write_basic(GByteArray *buffer, GVariant *value)
+{
+    guint8 byte;
+    guint16 u16;
+    guint64 u64;
+    gdouble number;
+
+    switch (g_variant_classify(value)) {
+    case G_VARIANT_CLASS_BOOLEAN:
+        write_u32(buffer, g_variant_get_boolean(value));
+        break;
+    case G_VARIANT_CLASS_BYTE:
+        byte = g_variant_get_byte(value);
+        g_byte_array_append(buffer, &byte, 1);
+        break;
+    case G_VARIANT_CLASS_INT16:
+    case G_VARIANT_CLASS_UINT16:
+        u16 = g_variant_classify(value) == G_VARIANT_CLASS_INT16
+              ? (guint16)g_variant_get_int16(value) : g_variant_get_uint16(value);
+        write_align(buffer, 2);
+        g_byte_array_append(buffer, (const guint8 *)&u16, 2);
+        break;
+    case G_VARIANT_CLASS_INT32:
+        write_u32(buffer, g_variant_get_int32(value));
+        break;
+    case G_VARIANT_CLASS_UINT32:
+        write_u32(buffer, g_variant_get_uint32(value));
+        break;
+    case G_VARIANT_CLASS_HANDLE:
+        write_u32(buffer, g_variant_get_handle(value));
+        break;
+    case G_VARIANT_CLASS_INT64:
+    case G_VARIANT_CLASS_UINT64:
+        u64 = g_variant_classify(value) == G_VARIANT_CLASS_INT64
+              ? (guint64)g_variant_get_int64(value) : g_variant_get_uint64(value);
+        write_align(buffer, 8);
+        g_byte_array_append(buffer, (const guint8 *)&u64, 8);
+        break;
+    case G_VARIANT_CLASS_DOUBLE:
+        number = g_variant_get_double(value);
+        write_align(buffer, 8);
+        g_byte_array_append(buffer, (const guint8 *)&number, 8);
+        break;
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+        write_string(buffer, g_variant_get_string(value, NULL));
+        break;
+    case G_VARIANT_CLASS_SIGNATURE:
+        write_signature(buffer, g_variant_get_string(value, NULL));
+        break;
+    default:
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean
+read_align(Reader *reader, gsize alignment)
+{
+    reader->pos = (reader->pos + alignment - 1) & ~(alignment - 1);
+    return reader->pos <= reader->size;
+}
+
+/* Reads a number of size bytes (1, 2, 4 or 8), aligned to its size */
+static gboolean
+read_fixed(Reader *reader, gsize size, gpointer value)
+{
+    guint8 *bytes = value;
+    gsize i;
+
+    if (!read_align(reader, size) || reader->size - reader->pos < size)
+        return FALSE;
+    for (i = 0; i < size; i++)
+        bytes[reader->swap ? size - 1 - i : i] = reader->data[reader->pos + i];
+    reader->pos += size;
+    return TRUE;
+}
+
+static gboolean
+read_string(Reader *reader, gboolean signature, const gchar **value)
+{
+    guint32 length;
+    guint8 short_length;
+
+    if (signature) {
+        if (!read_fixed(reader, 1, &short_length))
+            return FALSE;
+        length = short_length;
+    } else if (!read_fixed(reader, 4, &length)) {
+        return FALSE;
+    }
+    if (reader->size - reader->pos <= length
+        || reader->data[reader->pos + length] != '\0'
+        || memchr(reader->data + reader->pos, '\0', length))
+        return FALSE;
+    *value = (const gchar *)reader->data + reader->pos;
+    reader->pos += length + 1;
+    return TRUE;
+}
+
+/* Returns a floating reference, or NULL for anything but a valid basic value */
+static GVariant *
+read_basic(Reader *reader, gchar type)
+{
+    guint8 u8;
+    guint16 u16;
+    guint32 u32;
+    guint64 u64;
+    gdouble number;
+    const gchar *string;
+
+    switch (type) {
+    case 'y':
+        return read_fixed(reader, 1, &u8) ? g_variant_new_byte(u8) : NULL;
+    case 'b':
+        return read_fixed(reader, 4, &u32) && u32 <= 1
+               ? g_variant_new_boolean(u32) : NULL;
+    case 'n':
+        return read_fixed(reader, 2, &u16) ? g_variant_new_int16(u16) : NULL;
+    case 'q':
+        return read_fixed(reader, 2, &u16) ? g_variant_new_uint16(u16) : NULL;
+    case 'i':
+        return read_fixed(reader, 4, &u32) ? g_variant_new_int32(u32) : NULL;
+    case 'u':
+        return read_fixed(reader, 4, &u32) ? g_variant_new_uint32(u32) : NULL;
+    case 'h':
+        return read_fixed(reader, 4, &u32) ? g_variant_new_handle(u32) : NULL;
+    case 'x':
+        return read_fixed(reader, 8, &u64) ? g_variant_new_int64(u64) : NULL;
+    case 't':
+        return read_fixed(reader, 8, &u64) ? g_variant_new_uint64(u64) : NULL;
+    case 'd':
+        return read_fixed(reader, 8, &number) ? g_variant_new_double(number) : NULL;
+    case 's':
+        return read_string(reader, FALSE, &string) && g_utf8_validate(string, -1, NULL)
+               ? g_variant_new_string(string) : NULL;
+    case 'o':
+        return read_string(reader, FALSE, &string) && g_variant_is_object_path(string)
+               ? g_variant_new_object_path(string) : NULL;
+    case 'g':
+        return read_string(reader, TRUE, &string) && g_variant_is_signature(string)
+               ? g_variant_new_signature(string) : NULL;
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,237 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include "fullscreen.h"
+#include "xcb_utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FULLSCREEN_MAX_STATES 32    /* atoms read from _NET_WM_STATE */
+#define FULLSCREEN_MAX_CLASS  256   /* bytes read from WM_CLASS */
+
+enum {
+    ATOM_NET_ACTIVE_WINDOW,
+    ATOM_NET_WM_STATE,
+    ATOM_NET_WM_STATE_FULLSCREEN,
+    N_ATOMS
+};
+
+/* Follows the window manager's _NET_ACTIVE_WINDOW on the root window and
+ * the _NET_WM_STATE of whichever window it names, both through
+ * PropertyNotify, so nothing is polled.
+ */
+struct Fullscreen {
+    xcb_connection_t *connection;
+    xcb_window_t      root;
+    xcb_window_t      window;
+    gchar           **classes;
+    gboolean          matches;
+    gboolean          active;
+    xcb_atom_t        atoms[N_ATOMS];
+};
+
+static gboolean update_window(Fullscreen *fullscreen);
+static gboolean window_is_fullscreen(Fullscreen *fullscreen);
+static gboolean window_class_matches(Fullscreen *fullscreen);
+static void select_property_changes(Fullscreen *fullscreen, xcb_window_t window, gboolean select);
+static xcb_get_property_reply_t *get_property(Fullscreen *fullscreen, xcb_window_t window, xcb_atom_t property, xcb_atom_t type, uint32_t length);
+
+static const gchar *const atom_names[N_ATOMS] = {
+    "_NET_ACTIVE_WINDOW", "_NET_WM_STATE", "_NET_WM_STATE_FULLSCREEN"
+};
+
+/* With classes NULL, any fullscreen window counts; otherwise, only those
+ * whose WM_CLASS instance or class name is listed (ignoring case).
+ */
+Fullscreen *
+fullscreen_new(xcb_connection_t *connection, xcb_window_t root,
+               gchar **classes, GError **error)
+{
+    Fullscreen *fullscreen = g_new0(Fullscreen, 1);
+    xcb_intern_atom_cookie_t cookies[N_ATOMS];
+    xcb_intern_atom_reply_t *reply;
+    gboolean success = TRUE;
+    guint i;
+
+    fullscreen->connection = connection;
+    fullscreen->root = root;
+    fullscreen->classes = classes;
+
+    for (i = 0; i < N_ATOMS; i++)
+        cookies[i] = xcb_intern_atom(connection, FALSE, strlen(atom_names[i]),
+                                     atom_names[i]);
+    for (i = 0; i < N_ATOMS; i++) {
+        if ((reply = xcb_intern_atom_reply(connection, cookies[i], NULL)))
+            fullscreen->atoms[i] = reply->atom;
+        else
+            success = FALSE;
+        free(reply);
+    }
+    if (!success) {
+        g_set_error(error, XCB_ERROR, 0, "Failed to intern window manager atoms");
+        g_free(fullscreen);
+        return NULL;
+    }
+
+    select_property_changes(fullscreen, root, TRUE);
+    update_window(fullscreen);
+    fullscreen->active = window_is_fullscreen(fullscreen);
+    xcb_flush(connection);
+    return fullscreen;
+}
+
+void
+fullscreen_free(Fullscreen *fullscreen)
+{
+    g_free(fullscreen);
+}
+
+/* Returns whether the event changed the outcome of fullscreen_active() */
+gboolean
+fullscreen_handle_event(Fullscreen *fullscreen,
+                        xcb_property_notify_event_t *event)
+{
+    gboolean active;
+
+    if (event->window == fullscreen->root
+        && event->atom == fullscreen->atoms[ATOM_NET_ACTIVE_WINDOW]) {
+        if (!update_window(fullscreen))
+            return FALSE;
+    } else if (event->window != fullscreen->window
+               || event->atom != fullscreen->atoms[ATOM_NET_WM_STATE]) {
+        return FALSE;
+    }
+
+    active = window_is_fullscreen(fullscreen);
+    if (active == fullscreen->active)
+        return FALSE;
+    fullscreen->active = active;
+    return TRUE;
+}
+
+gboolean
+fullscreen_active(Fullscreen *fullscreen)
+{
+    return fullscreen->active;
+}
+
+/* Moves the PropertyNotify selection to the newly active window, before its
+ * state is read, so that no change in between goes unnoticed.
+ */
+static gboolean
+update_window(Fullscreen *fullscreen)
+{
+    xcb_get_property_reply_t *reply;
+    xcb_window_t window = XCB_WINDOW_NONE;
+
+    reply = get_property(fullscreen, fullscreen->root,
+                         fullscreen->atoms[ATOM_NET_ACTIVE_WINDOW],
+                         XCB_ATOM_WINDOW, 1);
+    if (reply && reply->format == 32
+        && xcb_get_property_value_length(reply) >= sizeof(xcb_window_t))
+        window = *(xcb_window_t *)xcb_get_property_value(reply);
+    free(reply);
+
+    if (window == fullscreen->window)
+        return FALSE;
+
+    if (fullscreen->window != XCB_WINDOW_NONE)
+        select_property_changes(fullscreen, fullscreen->window, FALSE);
+    fullscreen->window = window;
+    fullscreen->matches = FALSE;
+    if (window != XCB_WINDOW_NONE) {
+        select_property_changes(fullscreen, window, TRUE);
+        fullscreen->matches = window_class_matches(fullscreen);
+    }
+    return TRUE;
+}
+
+static gboolean
+window_is_fullscreen(Fullscreen *fullscreen)
+{
+    xcb_get_property_reply_t *reply;
+    xcb_atom_t *states;
+    gboolean found = FALSE;
+    int i, n;
+
+    if (fullscreen->window == XCB_WINDOW_NONE || !fullscreen->matches)
+        return FALSE;
+
+    reply = get_property(fullscreen, fullscreen->window,
+                         fullscreen->atoms[ATOM_NET_WM_STATE], XCB_ATOM_ATOM,
+                         FULLSCREEN_MAX_STATES);
+    if (!reply)
+        return FALSE;
+    if (reply->format == 32) {
+        states = xcb_get_property_value(reply);
+        n = xcb_get_property_value_length(reply) / sizeof(xcb_atom_t);
+        for (i = 0; i < n && !found; i++)
+            found = states[i] == fullscreen->atoms[ATOM_NET_WM_STATE_FULLSCREEN];
+    }
+    free(reply);
+    return found;
+}
+
+/* WM_CLASS holds two consecutive NUL-terminated strings */
+static gboolean
+window_class_matches(Fullscreen *fullscreen)
+{
+    xcb_get_property_reply_t *reply;
+    const gchar *value;
+    gchar **class;
+    gboolean found = FALSE;
+    int length, offset;
+
+    if (!fullscreen->classes)
+        return TRUE;
+
+    reply = get_property(fullscreen, fullscreen->window, XCB_ATOM_WM_CLASS,
+                         XCB_ATOM_STRING, FULLSCREEN_MAX_CLASS / 4);
+    if (!reply)
+        return FALSE;
+    value = xcb_get_property_value(reply);
+    length = xcb_get_property_value_length(reply);
+    for (offset = 0; offset < length && !found;
+         offset += strnlen(value + offset, length - offset) + 1) {
+        gchar *name = g_strndup(value + offset, length - offset);
+
+        for (class = fullscreen->classes; *class && !found; class++)
+            found = !g_ascii_strcasecmp(name, *class);
+        g_free(name);
+    }
+    free(reply);
+    return found;
+}
+
+/* The window may be gone by now; the error is discarded rather than
+ * delivered as an event.
+ */
+static void
+select_property_changes(Fullscreen *fullscreen, xcb_window_t window,
+                        gboolean select)
+{
+    uint32_t mask = select ? XCB_EVENT_MASK_PROPERTY_CHANGE
+                           : XCB_EVENT_MASK_NO_EVENT;
+    xcb_void_cookie_t cookie;
+
+    cookie = xcb_change_window_attributes_checked(fullscreen->connection, window,
+                                                  XCB_CW_EVENT_MASK, &mask);
+    xcb_discard_reply(fullscreen->connection, cookie.sequence);
+    xcb_event_mark_output();
+}
+
+static xcb_get_property_reply_t *
+get_property(Fullscreen *fullscreen, xcb_window_t window, xcb_atom_t property,
+             xcb_atom_t type, uint32_t length)
+{
+    xcb_get_property_cookie_t cookie;
+    xcb_get_property_reply_t *reply;
+    xcb_generic_error_t *xcb_error = NULL;
+
+    cookie = xcb_get_property(fullscreen->connection, FALSE, window, property,
+                              type, 0, length);
+    reply = xcb_get_property_reply(fullscreen->connection, cookie, &xcb_error);
+    free(xcb_error);
+    return reply;
+}
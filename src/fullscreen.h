@@ -0,0 +1,27 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef FULLSCREEN_H
+#define FULLSCREEN_H
+
+#include <glib.h>
+#include <xcb/xcb.h>
+
+G_BEGIN_DECLS
+
+typedef struct Fullscreen Fullscreen;
+
+Fullscreen *fullscreen_new(xcb_connection_t *connection, xcb_window_t root,
+                           gchar **classes, GError **error);
+
+void fullscreen_free(Fullscreen *fullscreen);
+
+gboolean fullscreen_handle_event(Fullscreen *fullscreen,
+                                 xcb_property_notify_event_t *event);
+
+gboolean fullscreen_active(Fullscreen *fullscreen);
+
+G_END_DECLS
+
+#endif /* FULLSCREEN_H */
@@ -0,0 +1,266 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include <gio/gio.h>
+
+#include "inhibit.h"
+#include "probes.h"
+#include "stats.h"
+
+typedef struct Inhibitor {
+    guint  cookie;
+    gchar *sender;
+    gchar *application;
+    gchar *reason;
+} Inhibitor;
+
+typedef struct Sender {
+    guint watch_id;
+    guint count;
+} Sender;
+
+static void inhibitor_free(Inhibitor *inhibitor);
+static void sender_free(Sender *sender);
+static void inhibit(const gchar *sender, const gchar *application, const gchar *reason, GDBusMethodInvocation *invocation);
+static void uninhibit(const gchar *sender, guint cookie, GDBusMethodInvocation *invocation);
+static void remove_inhibitor(Inhibitor *inhibitor);
+static void sender_vanished_cb(GDBusConnection *connection, const gchar *name, gpointer user_data);
+static void method_call_cb(GDBusConnection *connection, const gchar *sender, const gchar *object_path, const gchar *interface_name, const gchar *method_name, GVariant *parameters, GDBusMethodInvocation *invocation, gpointer user_data);
+static void bus_acquired_cb(GDBusConnection *connection, const gchar *name, gpointer user_data);
+static void name_lost_cb(GDBusConnection *connection, const gchar *name, gpointer user_data);
+
+static const gchar introspection_xml[] =
+    "<node>"
+    "  <interface name='" INHIBIT_SERVICE "'>"
+    "    <method name='Inhibit'>"
+    "      <arg type='s' name='application_name' direction='in'/>"
+    "      <arg type='s' name='reason_for_inhibit' direction='in'/>"
+    "      <arg type='u' name='cookie' direction='out'/>"
+    "    </method>"
+    "    <method name='UnInhibit'>"
+    "      <arg type='u' name='cookie' direction='in'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+
+/* Some applications use the path of the original KDE implementation */
+static const gchar *const object_paths[] = {INHIBIT_PATH, "/ScreenSaver"};
+
+static const GDBusInterfaceVTable interface_vtable = {method_call_cb};
+
+static GDBusConnection *bus = NULL;
+static GDBusNodeInfo *introspection_data = NULL;
+static guint owner_id = 0;
+static guint registration_ids[G_N_ELEMENTS(object_paths)];
+static GHashTable *inhibitors = NULL; /* cookie -> Inhibitor */
+static GHashTable *senders = NULL;    /* unique bus name -> Sender */
+static guint last_cookie = 0;
+static InhibitFunc inhibit_func = NULL;
+static gpointer inhibit_data = NULL;
+
+static void
+inhibitor_free(Inhibitor *inhibitor)
+{
+    g_free(inhibitor->sender);
+    g_free(inhibitor->application);
+    g_free(inhibitor->reason);
+    g_free(inhibitor);
+}
+
+static void
+sender_free(Sender *sender)
+{
+    g_bus_unwatch_name(sender->watch_id);
+    g_free(sender);
+}
+
+static void
+inhibit(const gchar *sender, const gchar *application, const gchar *reason,
+        GDBusMethodInvocation *invocation)
+{
+    Inhibitor *inhibitor = g_new(Inhibitor, 1);
+    Sender *watch = g_hash_table_lookup(senders, sender);
+
+    do
+        last_cookie++;
+    while (!last_cookie || g_hash_table_contains(inhibitors,
+                                                 GUINT_TO_POINTER(last_cookie)));
+
+    inhibitor->cookie = last_cookie;
+    inhibitor->sender = g_strdup(sender);
+    inhibitor->application = g_strdup(application);
+    inhibitor->reason = g_strdup(reason);
+    g_hash_table_insert(inhibitors, GUINT_TO_POINTER(inhibitor->cookie), inhibitor);
+    PROBE3(inhibit_acquire, inhibitor->cookie, inhibitor->sender,
+           inhibitor->application);
+
+    if (!watch) {
+        watch = g_new(Sender, 1);
+        watch->count = 0;
+        watch->watch_id =
+            g_bus_watch_name_on_connection(bus, sender,
+                                           G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                           NULL, sender_vanished_cb,
+                                           NULL, NULL);
+        g_hash_table_insert(senders, g_strdup(sender), watch);
+    }
+    watch->count++;
+
+    g_debug("Screen saver inhibited by %s (%s): %s",
+            application, sender, reason);
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(u)", inhibitor->cookie));
+
+    if (g_hash_table_size(inhibitors) == 1 && inhibit_func)
+        inhibit_func(TRUE, inhibit_data);
+}
+
+static void
+uninhibit(const gchar *sender, guint cookie, GDBusMethodInvocation *invocation)
+{
+    Inhibitor *inhibitor = g_hash_table_lookup(inhibitors,
+                                               GUINT_TO_POINTER(cookie));
+
+    if (!inhibitor || g_strcmp0(inhibitor->sender, sender)) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_INVALID_ARGS,
+                                              "Unknown cookie %u", cookie);
+        return;
+    }
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    remove_inhibitor(inhibitor);
+}
+
+static void
+remove_inhibitor(Inhibitor *inhibitor)
+{
+    Sender *watch = g_hash_table_lookup(senders, inhibitor->sender);
+
+    PROBE2(inhibit_release, inhibitor->cookie, inhibitor->sender);
+    g_debug("Screen saver no longer inhibited by %s (%s)",
+            inhibitor->application, inhibitor->sender);
+
+    if (watch && !--watch->count)
+        g_hash_table_remove(senders, inhibitor->sender);
+    g_hash_table_remove(inhibitors, GUINT_TO_POINTER(inhibitor->cookie));
+
+    if (!g_hash_table_size(inhibitors) && inhibit_func)
+        inhibit_func(FALSE, inhibit_data);
+}
+
+static void
+sender_vanished_cb(GDBusConnection *connection, const gchar *name,
+                   gpointer user_data)
+{
+    GHashTableIter iter;
+    Inhibitor *inhibitor;
+    GSList *stale = NULL, *link;
+
+    stats_count_wakeup(STATS_WAKEUP_DBUS);
+
+    g_hash_table_iter_init(&iter, inhibitors);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&inhibitor))
+        if (!g_strcmp0(inhibitor->sender, name))
+            stale = g_slist_prepend(stale, inhibitor);
+
+    for (link = stale; link; link = link->next)
+        remove_inhibitor(link->data);
+    g_slist_free(stale);
+}
+
+static void
+method_call_cb(GDBusConnection *connection, const gchar *sender,
+               const gchar *object_path, const gchar *interface_name,
+               const gchar *method_name, GVariant *parameters,
+               GDBusMethodInvocation *invocation, gpointer user_data)
+{
+    stats_count_wakeup(STATS_WAKEUP_DBUS);
+
+    if (!g_strcmp0(method_name, "Inhibit")) {
+        const gchar *application, *reason;
+
+        g_variant_get(parameters, "(&s&s)", &application, &reason);
+        inhibit(sender, application, reason, invocation);
+    } else if (!g_strcmp0(method_name, "UnInhibit")) {
+        guint32 cookie;
+
+        g_variant_get(parameters, "(u)", &cookie);
+        uninhibit(sender, cookie, invocation);
+    }
+}
+
+static void
+bus_acquired_cb(GDBusConnection *connection, const gchar *name,
+                gpointer user_data)
+{
+    GError *error = NULL;
+    guint i;
+
+    bus = g_object_ref(connection);
+    for (i = 0; i < G_N_ELEMENTS(object_paths); i++) {
+        registration_ids[i] =
+            g_dbus_connection_register_object(connection, object_paths[i],
+                                              introspection_data->interfaces[0],
+                                              &interface_vtable, NULL, NULL,
+                                              &error);
+        if (!registration_ids[i]) {
+            g_warning("Error registering %s: %s", object_paths[i], error->message);
+            g_clear_error(&error);
+        }
+    }
+}
+
+static void
+name_lost_cb(GDBusConnection *connection, const gchar *name,
+             gpointer user_data)
+{
+    g_warning("Could not own %s on the session bus; "
+              "is another screen saver service running?", name);
+}
+
+void
+inhibit_service_start(InhibitFunc function, gpointer data)
+{
+    g_return_if_fail(owner_id == 0);
+
+    inhibit_func = function;
+    inhibit_data = data;
+    inhibitors = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                       (GDestroyNotify)inhibitor_free);
+    senders = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                    (GDestroyNotify)sender_free);
+    introspection_data = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+    owner_id = g_bus_own_name(G_BUS_TYPE_SESSION, INHIBIT_SERVICE,
+                              G_BUS_NAME_OWNER_FLAGS_NONE, bus_acquired_cb,
+                              NULL, name_lost_cb, NULL, NULL);
+}
+
+void
+inhibit_service_stop(void)
+{
+    guint i;
+
+    if (!owner_id)
+        return;
+
+    g_bus_unown_name(owner_id);
+    owner_id = 0;
+    if (bus) {
+        for (i = 0; i < G_N_ELEMENTS(object_paths); i++)
+            if (registration_ids[i])
+                g_dbus_connection_unregister_object(bus, registration_ids[i]);
+        g_object_unref(bus);
+        bus = NULL;
+    }
+    g_hash_table_destroy(inhibitors);
+    g_hash_table_destroy(senders);
+    g_dbus_node_info_unref(introspection_data);
+    inhibit_func = NULL;
+}
+
+gboolean
+inhibit_service_active(void)
+{
+    return inhibitors && g_hash_table_size(inhibitors) > 0;
+}
@@ -0,0 +1,33 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef INHIBIT_H
+#define INHIBIT_H
+
+#include <glib.h>
+#include "config.h"
+
+G_BEGIN_DECLS
+
+#define INHIBIT_SERVICE "org.freedesktop.ScreenSaver"
+#define INHIBIT_PATH    "/org/freedesktop/ScreenSaver"
+
+typedef void (*InhibitFunc)(gboolean inhibited, gpointer user_data);
+
+/* Exporting a service takes GDBus; the lean build goes without */
+#if WITH_LEAN_DBUS
+#define inhibit_service_start(function, data) ((void)(function), (void)(data))
+#define inhibit_service_stop()                do {} while (0)
+#define inhibit_service_active()              FALSE
+#else
+void inhibit_service_start(InhibitFunc function, gpointer data);
+
+void inhibit_service_stop(void);
+
+gboolean inhibit_service_active(void);
+#endif
+
+G_END_DECLS
+
+#endif /* INHIBIT_H */
@@ -0,0 +1,27 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef PROBES_H
+#define PROBES_H
+
+#include "config.h"
+
+/* Static tracepoints in provider "xss_lock", for bpftrace and SystemTap. They
+ * compile to nothing, arguments included, unless built with WITH_USDT.
+ */
+#if WITH_USDT
+#include <sys/sdt.h>
+
+#define PROBE1(name, a)          STAP_PROBE1(xss_lock, name, a)
+#define PROBE2(name, a, b)       STAP_PROBE2(xss_lock, name, a, b)
+#define PROBE3(name, a, b, c)    STAP_PROBE3(xss_lock, name, a, b, c)
+#define PROBE4(name, a, b, c, d) STAP_PROBE4(xss_lock, name, a, b, c, d)
+#else
+#define PROBE1(name, a)          do {} while (0)
+#define PROBE2(name, a, b)       do {} while (0)
+#define PROBE3(name, a, b, c)    do {} while (0)
+#define PROBE4(name, a, b, c, d) do {} while (0)
+#endif
+
+#endif /* PROBES_H */
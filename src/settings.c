@@ -0,0 +1,251 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include "settings.h"
+#include "spawn.h"
+#include <string.h>
+
+static Settings *settings_copy(const Settings *settings);
+static gboolean settings_load(Settings *settings, const gchar *file, GError **error);
+static gboolean settings_load_key(Settings *settings, GKeyFile *key_file, const gchar *key, GError **error);
+static gboolean settings_resolve(Settings *settings, GError **error);
+
+gboolean
+settings_parse_cmd(const gchar *option_name, const gchar *value,
+                   gchar ***cmd, GError **error)
+{
+    gchar **argv;
+    GError *parse_error = NULL;
+
+    if (!g_shell_parse_argv(value, NULL, &argv, &parse_error)) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                    "Error parsing argument for %s: %s",
+                    option_name, parse_error->message);
+        g_error_free(parse_error);
+        return FALSE;
+    }
+    g_strfreev(*cmd);
+    *cmd = argv;
+    return TRUE;
+}
+
+gboolean
+settings_parse_trigger_locker(Settings *settings, const gchar *option_name,
+                              const gchar *value, GError **error)
+{
+    const gchar *colon = strchr(value, ':');
+    gchar *prefix, **trigger_flags = NULL;
+    StatsTrigger trigger;
+    TriggerLocker *trigger_locker;
+    gboolean success = FALSE;
+
+    if (colon) {
+        prefix = g_strndup(value, colon - value);
+        trigger_flags = g_strsplit(prefix, ",", 2);
+        g_free(prefix);
+    }
+    if (!colon || !colon[1] || !trigger_flags[0]
+        || !stats_trigger_from_string(trigger_flags[0], &trigger)
+        || (trigger_flags[1] && strcmp(trigger_flags[1], "l"))) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    "Invalid argument for %s: %s", option_name, value);
+        goto out;
+    }
+
+    trigger_locker = &settings->trigger_lockers[trigger];
+    if (!settings_parse_cmd(option_name, colon + 1, &trigger_locker->cmd, error))
+        goto out;
+    trigger_locker->transfer_sleep_lock_fd = trigger_flags[1] != NULL;
+    success = TRUE;
+
+out:
+    g_strfreev(trigger_flags);
+    return success;
+}
+
+/* Returns base overridden by the keys in file (if any), with every command
+ * looked up in $PATH; NULL if either fails, so the caller can keep what it
+ * has.
+ */
+Settings *
+settings_new(const Settings *base, const gchar *file, GError **error)
+{
+    Settings *settings = settings_copy(base);
+
+    if ((file && !settings_load(settings, file, error))
+        || !settings_resolve(settings, error)) {
+        settings_free(settings);
+        return NULL;
+    }
+    return settings;
+}
+
+void
+settings_clear(Settings *settings)
+{
+    guint i;
+
+    g_strfreev(settings->locker_cmd);
+    g_free(settings->locker_path);
+    g_strfreev(settings->notifier_cmd);
+    g_free(settings->notifier_path);
+    settings->locker_cmd = settings->notifier_cmd = NULL;
+    settings->locker_path = settings->notifier_path = NULL;
+    for (i = 0; i < STATS_N_TRIGGERS; i++) {
+        g_strfreev(settings->trigger_lockers[i].cmd);
+        g_free(settings->trigger_lockers[i].path);
+        settings->trigger_lockers[i].cmd = NULL;
+        settings->trigger_lockers[i].path = NULL;
+    }
+}
+
+void
+settings_free(Settings *settings)
+{
+    if (settings) {
+        settings_clear(settings);
+        g_free(settings);
+    }
+}
+
+/* Paths are not copied: they are resolved again for the copy */
+static Settings *
+settings_copy(const Settings *settings)
+{
+    Settings *copy = g_new(Settings, 1);
+    guint i;
+
+    *copy = *settings;
+    copy->locker_cmd = g_strdupv(settings->locker_cmd);
+    copy->locker_path = NULL;
+    copy->notifier_cmd = g_strdupv(settings->notifier_cmd);
+    copy->notifier_path = NULL;
+    for (i = 0; i < STATS_N_TRIGGERS; i++) {
+        copy->trigger_lockers[i].cmd = g_strdupv(settings->trigger_lockers[i].cmd);
+        copy->trigger_lockers[i].path = NULL;
+    }
+    return copy;
+}
+
+static gboolean
+settings_load(Settings *settings, const gchar *file, GError **error)
+{
+    GKeyFile *key_file = g_key_file_new();
+    gchar **keys = NULL, **key;
+    gboolean success;
+
+    success = g_key_file_load_from_file(key_file, file, G_KEY_FILE_NONE, error);
+    if (success && g_key_file_has_group(key_file, SETTINGS_GROUP))
+        success = (keys = g_key_file_get_keys(key_file, SETTINGS_GROUP,
+                                              NULL, error)) != NULL;
+    for (key = keys; success && key && *key; key++)
+        success = settings_load_key(settings, key_file, *key, error);
+    if (!success)
+        g_prefix_error(error, "%s: ", file);
+
+    g_strfreev(keys);
+    g_key_file_free(key_file);
+    return success;
+}
+
+/* Keys are named after the long options they override */
+static gboolean
+settings_load_key(Settings *settings, GKeyFile *key_file, const gchar *key,
+                  GError **error)
+{
+    gboolean *flag = NULL;
+    gint *number = NULL;
+    gchar *value, **values, **v;
+    GError *value_error = NULL;
+    gboolean success = TRUE;
+    guint i;
+
+    if (!strcmp(key, "locker") || !strcmp(key, "notifier")) {
+        gchar ***cmd = key[0] == 'l' ? &settings->locker_cmd
+                                     : &settings->notifier_cmd;
+
+        if (!(value = g_key_file_get_string(key_file, SETTINGS_GROUP, key, error)))
+            return FALSE;
+        if (*value) {
+            success = settings_parse_cmd(key, value, cmd, error);
+        } else {
+            g_strfreev(*cmd);
+            *cmd = NULL;
+        }
+        g_free(value);
+        return success;
+    }
+
+    if (!strcmp(key, "locker-for")) {
+        if (!(values = g_key_file_get_string_list(key_file, SETTINGS_GROUP, key,
+                                                  NULL, error)))
+            return FALSE;
+        for (i = 0; i < STATS_N_TRIGGERS; i++) {
+            g_strfreev(settings->trigger_lockers[i].cmd);
+            settings->trigger_lockers[i].cmd = NULL;
+        }
+        for (v = values; success && *v; v++)
+            success = settings_parse_trigger_locker(settings, key, *v, error);
+        g_strfreev(values);
+        return success;
+    }
+
+    if (!strcmp(key, "transfer-sleep-lock"))
+        flag = &settings->transfer_sleep_lock;
+    else if (!strcmp(key, "ignore-sleep"))
+        flag = &settings->ignore_sleep;
+    else if (!strcmp(key, "ready-timeout"))
+        number = &settings->ready_timeout;
+    else if (!strcmp(key, "kill-timeout"))
+        number = &settings->kill_timeout;
+    else if (!strcmp(key, "idle-hint-delay"))
+        number = &settings->idle_hint_delay;
+
+    if (flag) {
+        gboolean parsed = g_key_file_get_boolean(key_file, SETTINGS_GROUP, key,
+                                                 &value_error);
+        if (!value_error)
+            *flag = parsed;
+    } else if (number) {
+        gint parsed = g_key_file_get_integer(key_file, SETTINGS_GROUP, key,
+                                             &value_error);
+        if (!value_error)
+            *number = parsed;
+    } else {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                    "Unknown key %s", key);
+        return FALSE;
+    }
+
+    if (value_error) {
+        g_propagate_error(error, value_error);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Search $PATH once, instead of on every spawn */
+static gboolean
+settings_resolve(Settings *settings, GError **error)
+{
+    gboolean success;
+    guint i;
+
+    if (!settings->locker_cmd) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                    "No locker specified");
+        return FALSE;
+    }
+
+    success = (settings->locker_path = spawn_resolve(settings->locker_cmd[0], error))
+              && (!settings->notifier_cmd
+                  || (settings->notifier_path =
+                          spawn_resolve(settings->notifier_cmd[0], error)));
+    for (i = 0; success && i < STATS_N_TRIGGERS; i++)
+        if (settings->trigger_lockers[i].cmd)
+            success = (settings->trigger_lockers[i].path =
+                           spawn_resolve(settings->trigger_lockers[i].cmd[0],
+                                         error)) != NULL;
+    return success;
+}
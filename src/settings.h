@@ -0,0 +1,53 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <glib.h>
+
+#include "stats.h"
+
+G_BEGIN_DECLS
+
+#define SETTINGS_GROUP "xss-lock"
+
+/* A locker command of its own for one trigger */
+typedef struct TriggerLocker {
+    gchar  **cmd;
+    gchar   *path;
+    gboolean transfer_sleep_lock_fd;
+} TriggerLocker;
+
+/* Everything that can be changed while running, by reloading the
+ * configuration file; the rest only comes from the command line.
+ */
+typedef struct Settings {
+    gchar        **locker_cmd;
+    gchar         *locker_path;
+    gchar        **notifier_cmd;
+    gchar         *notifier_path;
+    TriggerLocker  trigger_lockers[STATS_N_TRIGGERS];
+    gboolean       transfer_sleep_lock;
+    gboolean       ignore_sleep;
+    gint           ready_timeout;
+    gint           kill_timeout;
+    gint           idle_hint_delay;
+} Settings;
+
+gboolean settings_parse_cmd(const gchar *option_name, const gchar *value,
+                            gchar ***cmd, GError **error);
+
+gboolean settings_parse_trigger_locker(Settings *settings, const gchar *option_name,
+                                       const gchar *value, GError **error);
+
+Settings *settings_new(const Settings *base, const gchar *file, GError **error);
+
+void settings_clear(Settings *settings);
+
+void settings_free(Settings *settings);
+
+G_END_DECLS
+
+#endif /* SETTINGS_H */
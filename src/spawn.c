@@ -0,0 +1,219 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <glib-unix.h>
+
+#include "spawn.h"
+
+/* Made-up PIDs start above the kernel's maximum (2^22) */
+#define DRY_RUN_FIRST_PID 0x40000000
+
+static void close_from(gint first, gint keep);
+static void child_exec(const gchar *path, gchar **argv, gchar **envp, gint child_fd, gint error_fd) G_GNUC_NORETURN;
+
+static gint child_nice = G_MAXINT;
+static gboolean dry_run = FALSE;
+static GPid dry_run_pid = DRY_RUN_FIRST_PID;
+static GHashTable *dry_run_fds = NULL;
+
+/* Close everything from first up, except keep; runs between fork and exec,
+ * so only async-signal-safe calls are allowed.
+ */
+static void
+close_from(gint first, gint keep)
+{
+    long fd, max_fd;
+
+#ifdef SYS_close_range
+    if ((keep == first || syscall(SYS_close_range, first, keep - 1, 0) == 0)
+        && syscall(SYS_close_range, keep + 1, ~0U, 0) == 0)
+        return;
+#endif
+    max_fd = sysconf(_SC_OPEN_MAX);
+    for (fd = first; fd < max_fd; fd++)
+        if (fd != keep)
+            close(fd);
+}
+
+static void
+child_exec(const gchar *path, gchar **argv, gchar **envp, gint child_fd,
+           gint error_fd)
+{
+    sigset_t mask;
+    gint error;
+
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    if (child_nice != G_MAXINT)
+        setpriority(PRIO_PROCESS, 0, child_nice);
+
+    if (child_fd == SPAWN_CHILD_FD) {
+        if (fcntl(child_fd, F_SETFD, 0) < 0)
+            goto error;
+    } else if (child_fd >= 0 && dup2(child_fd, SPAWN_CHILD_FD) < 0) {
+        goto error;
+    }
+    close_from(child_fd >= 0 ? SPAWN_CHILD_FD + 1 : SPAWN_CHILD_FD, error_fd);
+
+    execve(path, argv, envp);
+
+error:
+    error = errno;
+    while (write(error_fd, &error, sizeof(error)) < 0 && errno == EINTR);
+    _exit(127);
+}
+
+/* Resolved once, so that spawning does not have to search $PATH */
+gchar *
+spawn_resolve(const gchar *program, GError **error)
+{
+    gchar *path = g_find_program_in_path(program);
+
+    if (!path)
+        g_set_error(error, G_SPAWN_ERROR, G_SPAWN_ERROR_NOENT,
+                    "Command not found: %s", program);
+    return path;
+}
+
+/* Returns a copy of base with variable pointing at SPAWN_CHILD_FD */
+gchar **
+spawn_environ(gchar **base, const gchar *variable)
+{
+    return g_environ_setenv(g_strdupv(base), variable,
+                            G_STRINGIFY(SPAWN_CHILD_FD), TRUE);
+}
+
+/* Starts path with exactly stdin, stdout, stderr and, if child_fd is not -1,
+ * child_fd as SPAWN_CHILD_FD. The caller reaps the child.
+ */
+gboolean
+spawn_async(const gchar *path, gchar **argv, gchar **envp, gint child_fd,
+            GPid *pid, GError **error)
+{
+    gint error_pipe[2];
+    gint child_error = 0;
+    gssize length;
+
+    if (dry_run) {
+        *pid = dry_run_pid++;
+        if (child_fd >= 0)
+            g_hash_table_insert(dry_run_fds, GINT_TO_POINTER(*pid),
+                                GINT_TO_POINTER(fcntl(child_fd, F_DUPFD_CLOEXEC, 0)));
+        return TRUE;
+    }
+
+    if (!g_unix_open_pipe(error_pipe, FD_CLOEXEC, error))
+        return FALSE;
+
+    /* Keep the error pipe clear of the descriptor the child gets */
+    if (error_pipe[1] <= SPAWN_CHILD_FD) {
+        gint fd = fcntl(error_pipe[1], F_DUPFD_CLOEXEC, SPAWN_CHILD_FD + 1);
+
+        close(error_pipe[1]);
+        if ((error_pipe[1] = fd) < 0) {
+            g_set_error(error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                        "Failed to create pipe: %s", g_strerror(errno));
+            close(error_pipe[0]);
+            return FALSE;
+        }
+    }
+
+    *pid = fork();
+    if (*pid == 0)
+        child_exec(path, argv, envp, child_fd, error_pipe[1]);
+    close(error_pipe[1]);
+
+    if (*pid < 0) {
+        g_set_error(error, G_SPAWN_ERROR, G_SPAWN_ERROR_FORK,
+                    "Failed to fork: %s", g_strerror(errno));
+        close(error_pipe[0]);
+        return FALSE;
+    }
+
+    while ((length = read(error_pipe[0], &child_error, sizeof(child_error))) < 0
+           && errno == EINTR);
+    close(error_pipe[0]);
+
+    if (length == sizeof(child_error)) {
+        waitpid(*pid, NULL, 0);
+        *pid = 0;
+        g_set_error(error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                    "Failed to execute %s: %s", path, g_strerror(child_error));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Returns -1 if the kernel has no pidfds (before Linux 5.3) */
+gint
+spawn_pidfd_open(GPid pid)
+{
+#ifdef SYS_pidfd_open
+    gint pidfd;
+
+    if (dry_run)
+        return -1;
+    pidfd = syscall(SYS_pidfd_open, pid, 0);
+
+    if (pidfd >= 0)
+        fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+    return pidfd;
+#else
+    return -1;
+#endif
+}
+
+/* Signals through the pidfd when there is one, so that a reused PID can
+ * never be hit
+ */
+gboolean
+spawn_kill(GPid pid, gint pidfd, gint signal)
+{
+    if (dry_run)
+        return TRUE;
+#ifdef SYS_pidfd_send_signal
+    if (pidfd >= 0)
+        return syscall(SYS_pidfd_send_signal, pidfd, signal, NULL, 0) == 0;
+#endif
+    return kill(pid, signal) == 0;
+}
+
+/* Children start at nice value nice, whatever xss-lock runs at meanwhile */
+void
+spawn_set_nice(gint nice)
+{
+    child_nice = nice;
+}
+
+/* For replaying a trace: nothing is started or signalled. Each child gets a
+ * made-up PID and, like a real process, holds on to a copy of the descriptor
+ * passed to it until it is released.
+ */
+void
+spawn_set_dry_run(gboolean enabled)
+{
+    dry_run = enabled;
+    if (enabled && !dry_run_fds)
+        dry_run_fds = g_hash_table_new(NULL, NULL);
+}
+
+void
+spawn_dry_run_release(GPid pid)
+{
+    gpointer fd;
+
+    if (dry_run_fds && g_hash_table_lookup_extended(dry_run_fds, GINT_TO_POINTER(pid),
+                                                    NULL, &fd)) {
+        if (GPOINTER_TO_INT(fd) >= 0)
+            close(GPOINTER_TO_INT(fd));
+        g_hash_table_remove(dry_run_fds, GINT_TO_POINTER(pid));
+    }
+}
@@ -0,0 +1,34 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The only descriptor besides stdin/stdout/stderr that a child gets */
+#define SPAWN_CHILD_FD 3
+
+gchar *spawn_resolve(const gchar *program, GError **error);
+
+gchar **spawn_environ(gchar **base, const gchar *variable);
+
+gboolean spawn_async(const gchar *path, gchar **argv, gchar **envp,
+                     gint child_fd, GPid *pid, GError **error);
+
+gint spawn_pidfd_open(GPid pid);
+
+gboolean spawn_kill(GPid pid, gint pidfd, gint signal);
+
+void spawn_set_nice(gint nice);
+
+void spawn_set_dry_run(gboolean enabled);
+
+void spawn_dry_run_release(GPid pid);
+
+G_END_DECLS
+
+#endif /* SPAWN_H */
@@ -0,0 +1,199 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include "stats.h"
+#include "config.h"
+#include "trace.h"
+#include <string.h>
+
+/* Bucket i counts latencies below 2^i microseconds; the last bucket catches
+ * everything from 2^(STATS_N_BUCKETS - 2) us (about 8 s) upwards.
+ */
+#define STATS_N_BUCKETS 25
+
+typedef struct Histogram {
+    guint64 count;
+    guint64 sum_us;
+    guint64 max_us;
+    guint64 buckets[STATS_N_BUCKETS];
+} Histogram;
+
+static guint bucket_index(guint64 us);
+static void histogram_to_json(GString *json, const Histogram *histogram);
+
+static const gchar *const trigger_names[STATS_N_TRIGGERS] = {
+    "saver", "cycle", "sleep", "lock", "idle"
+};
+static const gchar *const stage_names[STATS_N_STAGES] = {
+    "dispatch", "start", "spawn", "sleep_lock_release"
+};
+
+static const gchar *const startup_names[STATS_N_STARTUP] = {
+    "armed", "ready"
+};
+
+static const gchar *const wakeup_names[STATS_N_WAKEUPS] = {
+    "x", "dbus", "signal", "child", "timer", "config"
+};
+
+static Histogram latency[STATS_N_TRIGGERS][STATS_N_STAGES];
+static gint64 startup_us[STATS_N_STARTUP];
+static guint64 wakeups[STATS_N_WAKEUPS];
+static guint64 flushes = 0;
+static guint64 events = 0;
+static guint64 respawns = 0;
+static volatile gint sources = 0;
+
+gboolean
+stats_trigger_from_string(const gchar *name, StatsTrigger *trigger)
+{
+    guint i;
+
+    for (i = 0; i < STATS_N_TRIGGERS; i++) {
+        if (!strcmp(name, trigger_names[i])) {
+            *trigger = i;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static guint
+bucket_index(guint64 us)
+{
+    guint i = 0;
+
+    while (i < STATS_N_BUCKETS - 1 && us >= (G_GUINT64_CONSTANT(1) << i))
+        i++;
+    return i;
+}
+
+void
+stats_record_latency(StatsTrigger trigger, StatsStage stage,
+                     gint64 trigger_time)
+{
+    Histogram *histogram = &latency[trigger][stage];
+    gint64 now = trace_now();
+    guint64 us = now > trigger_time ? now - trigger_time : 0;
+
+    histogram->count++;
+    histogram->sum_us += us;
+    histogram->max_us = MAX(histogram->max_us, us);
+    histogram->buckets[bucket_index(us)]++;
+}
+
+void
+stats_record_startup(StatsStartup milestone, gint64 start_time)
+{
+    startup_us[milestone] = MAX(trace_now() - start_time, 1);
+}
+
+void
+stats_count_wakeup(StatsWakeup source)
+{
+    wakeups[source]++;
+}
+
+void
+stats_count_flush(void)
+{
+    flushes++;
+}
+
+void
+stats_count_events(guint count)
+{
+    events += count;
+}
+
+void
+stats_count_respawn(void)
+{
+    respawns++;
+}
+
+/* GLib cannot list the sources of a context, so each source xss-lock adds is
+ * counted, with stats_source_removed() as its GDestroyNotify. Either may be
+ * called from GDBus's worker thread.
+ */
+void
+stats_source_added(void)
+{
+    g_atomic_int_inc(&sources);
+}
+
+void
+stats_source_removed(gpointer data)
+{
+    g_atomic_int_add(&sources, -1);
+}
+
+static void
+histogram_to_json(GString *json, const Histogram *histogram)
+{
+    guint i;
+
+    g_string_append_printf(json, "{\"count\":%" G_GUINT64_FORMAT
+                                 ",\"sum_us\":%" G_GUINT64_FORMAT
+                                 ",\"max_us\":%" G_GUINT64_FORMAT
+                                 ",\"buckets\":[",
+                           histogram->count, histogram->sum_us,
+                           histogram->max_us);
+    for (i = 0; i < STATS_N_BUCKETS; i++)
+        g_string_append_printf(json, i ? ",%" G_GUINT64_FORMAT
+                                       : "%" G_GUINT64_FORMAT,
+                               histogram->buckets[i]);
+    g_string_append(json, "]}");
+}
+
+/* Returns a single line of JSON; bucket i of every histogram holds the
+ * latencies below the i-th entry of "bucket_bounds_us" (null meaning no
+ * upper bound).
+ */
+gchar *
+stats_to_json(void)
+{
+    GString *json = g_string_new(NULL);
+    guint i, j;
+
+    g_string_append_printf(json, "{\"version\":\"%s\",\"monotonic_us\":%"
+                                 G_GINT64_FORMAT ",\"bucket_bounds_us\":[",
+                           VERSION, trace_now());
+    for (i = 0; i < STATS_N_BUCKETS - 1; i++)
+        g_string_append_printf(json, "%" G_GUINT64_FORMAT ",",
+                               G_GUINT64_CONSTANT(1) << i);
+    g_string_append(json, "null],\"latency\":{");
+
+    for (i = 0; i < STATS_N_TRIGGERS; i++) {
+        g_string_append_printf(json, "%s\"%s\":{", i ? "," : "",
+                               trigger_names[i]);
+        for (j = 0; j < STATS_N_STAGES; j++) {
+            g_string_append_printf(json, "%s\"%s\":", j ? "," : "",
+                                   stage_names[j]);
+            histogram_to_json(json, &latency[i][j]);
+        }
+        g_string_append_c(json, '}');
+    }
+    g_string_append(json, "},\"startup_us\":{");
+    for (i = 0; i < STATS_N_STARTUP; i++) {
+        if (startup_us[i])
+            g_string_append_printf(json, "%s\"%s\":%" G_GINT64_FORMAT,
+                                   i ? "," : "", startup_names[i], startup_us[i]);
+        else
+            g_string_append_printf(json, "%s\"%s\":null",
+                                   i ? "," : "", startup_names[i]);
+    }
+    g_string_append(json, "},\"wakeups\":{");
+    for (i = 0; i < STATS_N_WAKEUPS; i++)
+        g_string_append_printf(json, "%s\"%s\":%" G_GUINT64_FORMAT,
+                               i ? "," : "", wakeup_names[i], wakeups[i]);
+    g_string_append_printf(json, "},\"flushes\":%" G_GUINT64_FORMAT
+                                 ",\"events\":%" G_GUINT64_FORMAT
+                                 ",\"respawns\":%" G_GUINT64_FORMAT
+                                 ",\"sources\":%d}",
+                           flushes, events, respawns,
+                           g_atomic_int_get(&sources));
+
+    return g_string_free(json, FALSE);
+}
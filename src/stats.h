@@ -0,0 +1,67 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    STATS_TRIGGER_SAVER,        /* screen saver activated (forced/no notifier) */
+    STATS_TRIGGER_CYCLE,        /* screen saver cycle after notifier */
+    STATS_TRIGGER_SLEEP,        /* logind PrepareForSleep */
+    STATS_TRIGGER_SESSION_LOCK, /* logind session Lock */
+    STATS_TRIGGER_IDLE,         /* idle stage without a command of its own */
+    STATS_N_TRIGGERS
+} StatsTrigger;
+
+typedef enum {
+    STATS_STAGE_DISPATCH,           /* trigger event handled (queueing delay) */
+    STATS_STAGE_START,              /* locker start requested */
+    STATS_STAGE_SPAWN,              /* locker process spawned */
+    STATS_STAGE_SLEEP_LOCK_RELEASE, /* sleep delay lock released */
+    STATS_N_STAGES
+} StatsStage;
+
+typedef enum {
+    STATS_STARTUP_ARMED,        /* screen saver registered */
+    STATS_STARTUP_READY,        /* sleep inhibitor and sessions in place */
+    STATS_N_STARTUP
+} StatsStartup;
+
+typedef enum {
+    STATS_WAKEUP_X,             /* X connection readable or events queued */
+    STATS_WAKEUP_DBUS,          /* D-Bus signal or method reply */
+    STATS_WAKEUP_SIGNAL,        /* Unix signal */
+    STATS_WAKEUP_CHILD,         /* child exit or readiness channel */
+    STATS_WAKEUP_TIMER,         /* timeout or backlight fade step */
+    STATS_WAKEUP_CONFIG,        /* change in the configuration directory */
+    STATS_N_WAKEUPS
+} StatsWakeup;
+
+gboolean stats_trigger_from_string(const gchar *name, StatsTrigger *trigger);
+
+void stats_record_latency(StatsTrigger trigger, StatsStage stage, gint64 trigger_time);
+
+void stats_record_startup(StatsStartup milestone, gint64 start_time);
+
+void stats_count_wakeup(StatsWakeup source);
+
+void stats_count_flush(void);
+
+void stats_count_events(guint count);
+
+void stats_count_respawn(void);
+
+void stats_source_added(void);
+
+void stats_source_removed(gpointer data);
+
+gchar *stats_to_json(void);
+
+G_END_DECLS
+
+#endif /* STATS_H */
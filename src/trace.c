@@ -0,0 +1,327 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#include "trace.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The file starts with a header of TRACE_MAGIC, the format version, the
+ * number of screens (all little-endian 32 bits) and the monotonic start
+ * time (64 bits). Each record follows as the time since the previous one
+ * (varint, microseconds), input, screen and three argument bytes, and the
+ * value (zigzag varint).
+ */
+#define TRACE_MAGIC       "XSSTRACE"
+#define TRACE_VERSION     1
+#define TRACE_HEADER_SIZE 24
+#define TRACE_MAX_RECORD  20
+
+/* A timeout on the virtual clock */
+typedef struct VirtualTimeout {
+    guint       id;
+    gint64      due;
+    guint       interval;
+    GSourceFunc function;
+    gpointer    data;
+} VirtualTimeout;
+
+static gsize put_varint(guint8 *buf, guint64 value);
+static gboolean get_varint(const guint8 **p, const guint8 *end, guint64 *value);
+static gint compare_timeouts(gconstpointer a, gconstpointer b);
+
+static const gchar *const input_names[TRACE_N_INPUTS] = {
+    "saver", "idle_alarm", "sleep", "session_lock", "child_exit",
+    "child_finished", "locker_ready", "inhibit", "signal"
+};
+
+static gint record_fd = -1;
+static gint64 record_time = 0;
+static gboolean virtual_clock = FALSE;
+static gint64 virtual_now = 0;
+static GSList *timeouts = NULL;
+static guint last_timeout_id = 0;
+static guint firing_id = 0;
+static gboolean firing_removed = FALSE;
+
+GQuark
+trace_error_quark(void)
+{
+    return g_quark_from_static_string("trace-error-quark");
+}
+
+const gchar *
+trace_input_name(TraceInput input)
+{
+    return input_names[input];
+}
+
+gboolean
+trace_record_start(const gchar *file, guint screens, gint64 start_time,
+                   GError **error)
+{
+    guint8 header[TRACE_HEADER_SIZE];
+    guint32 u32;
+    gint64 i64;
+
+    memcpy(header, TRACE_MAGIC, 8);
+    u32 = GUINT32_TO_LE(TRACE_VERSION);
+    memcpy(header + 8, &u32, 4);
+    u32 = GUINT32_TO_LE(screens);
+    memcpy(header + 12, &u32, 4);
+    i64 = GINT64_TO_LE(start_time);
+    memcpy(header + 16, &i64, 8);
+
+    record_fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (record_fd < 0
+        || write(record_fd, header, sizeof(header)) != sizeof(header)) {
+        g_set_error(error, TRACE_ERROR, 0, "Error writing trace %s: %s",
+                    file, g_strerror(errno));
+        trace_record_stop();
+        return FALSE;
+    }
+    record_time = start_time;
+    return TRUE;
+}
+
+void
+trace_record_stop(void)
+{
+    if (record_fd >= 0)
+        close(record_fd);
+    record_fd = -1;
+}
+
+/* Written right away, so that a trace survives a crash */
+void
+trace_record(TraceInput input, guint screen, guint8 arg0, guint8 arg1,
+             guint8 arg2, gint32 value)
+{
+    guint8 buf[TRACE_MAX_RECORD];
+    gint64 now;
+    gsize length;
+
+    if (record_fd < 0)
+        return;
+
+    now = trace_now();
+    length = put_varint(buf, MAX(now - record_time, 0));
+    record_time = MAX(now, record_time);
+    buf[length++] = input;
+    buf[length++] = screen;
+    buf[length++] = arg0;
+    buf[length++] = arg1;
+    buf[length++] = arg2;
+    length += put_varint(buf + length,
+                         ((guint32)value << 1) ^ (guint32)(value >> 31));
+
+    if (write(record_fd, buf, length) != (gssize)length) {
+        g_warning("Error writing trace: %s; recording stopped",
+                  g_strerror(errno));
+        trace_record_stop();
+    }
+}
+
+Trace *
+trace_load(const gchar *file, GError **error)
+{
+    gchar *contents;
+    gsize size;
+    const guint8 *p, *end;
+    Trace *trace;
+    TraceRecord record;
+    guint32 u32;
+    gint64 i64;
+    guint64 delta, value;
+
+    if (!g_file_get_contents(file, &contents, &size, error))
+        return NULL;
+
+    if (size < TRACE_HEADER_SIZE || memcmp(contents, TRACE_MAGIC, 8)) {
+        g_set_error(error, TRACE_ERROR, 0, "%s is not a trace", file);
+        g_free(contents);
+        return NULL;
+    }
+    memcpy(&u32, contents + 8, 4);
+    if (GUINT32_FROM_LE(u32) != TRACE_VERSION) {
+        g_set_error(error, TRACE_ERROR, 0, "%s: unsupported trace version %u",
+                    file, GUINT32_FROM_LE(u32));
+        g_free(contents);
+        return NULL;
+    }
+
+    trace = g_new0(Trace, 1);
+    memcpy(&u32, contents + 12, 4);
+    trace->screens = GUINT32_FROM_LE(u32);
+    memcpy(&i64, contents + 16, 8);
+    trace->start_time = GINT64_FROM_LE(i64);
+    trace->records = g_array_new(FALSE, FALSE, sizeof(TraceRecord));
+
+    record.time = trace->start_time;
+    p = (const guint8 *)contents + TRACE_HEADER_SIZE;
+    end = (const guint8 *)contents + size;
+    while (p < end) {
+        if (!get_varint(&p, end, &delta) || end - p < 5
+            || (record.input = p[0]) >= TRACE_N_INPUTS
+            || (record.screen = p[1]) >= trace->screens) {
+            g_set_error(error, TRACE_ERROR, 0, "%s: corrupt record at byte %ld",
+                        file, (long)(p - (const guint8 *)contents));
+            trace_free(trace);
+            trace = NULL;
+            break;
+        }
+        memcpy(record.args, p + 2, 3);
+        p += 5;
+        if (!get_varint(&p, end, &value)) {
+            g_set_error(error, TRACE_ERROR, 0, "%s: truncated", file);
+            trace_free(trace);
+            trace = NULL;
+            break;
+        }
+        record.time += delta;
+        record.value = (gint32)((guint32)value >> 1) ^ -(gint32)(value & 1);
+        g_array_append_val(trace->records, record);
+    }
+    g_free(contents);
+    return trace;
+}
+
+void
+trace_free(Trace *trace)
+{
+    g_array_free(trace->records, TRUE);
+    g_free(trace);
+}
+
+/* The virtual clock only moves when a replay advances it */
+gint64
+trace_now(void)
+{
+    return virtual_clock ? virtual_now : g_get_monotonic_time();
+}
+
+void
+trace_clock_start(gint64 time)
+{
+    virtual_clock = TRUE;
+    virtual_now = time;
+}
+
+/* Runs every virtual timeout due up to time, each at its own due time */
+void
+trace_clock_advance(gint64 time)
+{
+    while (timeouts && ((VirtualTimeout *)timeouts->data)->due <= time) {
+        VirtualTimeout *timeout = timeouts->data;
+
+        timeouts = g_slist_delete_link(timeouts, timeouts);
+        virtual_now = MAX(virtual_now, timeout->due);
+        firing_id = timeout->id;
+        firing_removed = FALSE;
+        if (timeout->function(timeout->data) && !firing_removed) {
+            timeout->due += MAX(timeout->interval, 1) * (gint64)1000;
+            timeouts = g_slist_insert_sorted(timeouts, timeout, compare_timeouts);
+        } else {
+            g_free(timeout);
+        }
+        firing_id = 0;
+    }
+    virtual_now = MAX(virtual_now, time);
+}
+
+guint
+trace_timeout_add(guint interval, GSourceFunc function, gpointer data)
+{
+    return trace_timeout_add_full(G_PRIORITY_DEFAULT, interval, function, data);
+}
+
+/* Like g_timeout_add_full(), but on the virtual clock while replaying, where
+ * timeouts simply fire in order of their due time.
+ */
+guint
+trace_timeout_add_full(gint priority, guint interval, GSourceFunc function,
+                       gpointer data)
+{
+    VirtualTimeout *timeout;
+
+    if (!virtual_clock) {
+        stats_source_added();
+        return g_timeout_add_full(priority, interval, function, data,
+                                  stats_source_removed);
+    }
+
+    timeout = g_new(VirtualTimeout, 1);
+    timeout->id = ++last_timeout_id;
+    timeout->due = virtual_now + interval * (gint64)1000;
+    timeout->interval = interval;
+    timeout->function = function;
+    timeout->data = data;
+    timeouts = g_slist_insert_sorted(timeouts, timeout, compare_timeouts);
+    return timeout->id;
+}
+
+void
+trace_source_remove(guint id)
+{
+    GSList *link;
+
+    if (!virtual_clock) {
+        g_source_remove(id);
+        return;
+    }
+
+    if (id == firing_id) {
+        firing_removed = TRUE;
+        return;
+    }
+    for (link = timeouts; link; link = link->next) {
+        if (((VirtualTimeout *)link->data)->id == id) {
+            g_free(link->data);
+            timeouts = g_slist_delete_link(timeouts, link);
+            return;
+        }
+    }
+}
+
+static gsize
+put_varint(guint8 *buf, guint64 value)
+{
+    gsize length = 0;
+
+    while (value >= 0x80) {
+        buf[length++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buf[length++] = value;
+    return length;
+}
+
+static gboolean
+get_varint(const guint8 **p, const guint8 *end, guint64 *value)
+{
+    guint shift;
+
+    *value = 0;
+    for (shift = 0; *p < end && shift < 64; shift += 7) {
+        guint8 byte = *(*p)++;
+
+        *value |= (guint64)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Equal due times fire in the order they were added */
+static gint
+compare_timeouts(gconstpointer a, gconstpointer b)
+{
+    const VirtualTimeout *timeout_a = a, *timeout_b = b;
+
+    if (timeout_a->due != timeout_b->due)
+        return (timeout_a->due > timeout_b->due) - (timeout_a->due < timeout_b->due);
+    return (timeout_a->id > timeout_b->id) - (timeout_a->id < timeout_b->id);
+}
@@ -0,0 +1,74 @@
+/* Copyright (c) 2026 The xss-lock contributors
+ *
+ * See LICENSE for the MIT license.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define TRACE_ERROR trace_error_quark()
+
+#define TRACE_IDLE_RESET 0xff   /* idle alarm argument for renewed activity */
+
+/* Every input that drives the state machine; args and value as noted */
+typedef enum {
+    TRACE_INPUT_SAVER,          /* state, kind, forced */
+    TRACE_INPUT_IDLE_ALARM,     /* idle stage or TRACE_IDLE_RESET */
+    TRACE_INPUT_SLEEP,          /* PrepareForSleep active */
+    TRACE_INPUT_SESSION_LOCK,   /* Lock (1) or Unlock (0) */
+    TRACE_INPUT_CHILD_EXIT,     /* child, descendants left; value: wait status */
+    TRACE_INPUT_CHILD_FINISHED, /* child; value: last descendant's wait status */
+    TRACE_INPUT_LOCKER_READY,   /* (none) */
+    TRACE_INPUT_INHIBIT,        /* inhibited */
+    TRACE_INPUT_SIGNAL,         /* value: signal number */
+    TRACE_N_INPUTS
+} TraceInput;
+
+typedef struct TraceRecord {
+    gint64     time;            /* monotonic clock, microseconds */
+    TraceInput input;
+    guint8     screen;
+    guint8     args[3];
+    gint32     value;
+} TraceRecord;
+
+typedef struct Trace {
+    guint   screens;
+    gint64  start_time;
+    GArray *records;
+} Trace;
+
+GQuark trace_error_quark(void) G_GNUC_CONST;
+
+const gchar *trace_input_name(TraceInput input);
+
+gboolean trace_record_start(const gchar *file, guint screens, gint64 start_time,
+                            GError **error);
+
+void trace_record_stop(void);
+
+void trace_record(TraceInput input, guint screen, guint8 arg0, guint8 arg1,
+                  guint8 arg2, gint32 value);
+
+Trace *trace_load(const gchar *file, GError **error);
+
+void trace_free(Trace *trace);
+
+gint64 trace_now(void);
+
+void trace_clock_start(gint64 time);
+
+void trace_clock_advance(gint64 time);
+
+guint trace_timeout_add(guint interval, GSourceFunc function, gpointer data);
+
+guint trace_timeout_add_full(gint priority, guint interval, GSourceFunc function, gpointer data);
+
+void trace_source_remove(guint id);
+
+G_END_DECLS
+
+#endif /* TRACE_H */
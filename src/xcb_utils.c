@@ -3,18 +3,34 @@
  * See LICENSE for the MIT license.
  */
 #include "xcb_utils.h"
+#include "stats.h"
 #include <stdlib.h>
 
+#define XCB_EVENT_QUEUE_SIZE 64
+
+/* Events are kept in a fixed-size ring buffer, along with the time they were
+ * read; once it is full, further events are left in libxcb's queue until the
+ * ring has been drained. The connection is only flushed once a callback has
+ * said it left requests behind.
+ */
 typedef struct XcbEventSource {
     GSource source;
     xcb_connection_t *connection;
 #if !GLIB_CHECK_VERSION(2, 36, 0)
     GPollFD poll;
 #endif
-    GQueue *queue;
+    xcb_generic_event_t *queue[XCB_EVENT_QUEUE_SIZE];
+    gint64 arrival[XCB_EVENT_QUEUE_SIZE];
+    guint head;
+    guint length;
+    gboolean full;
+    XcbCoalesceFunc coalesce;
+    gpointer coalesce_data;
+    gboolean pending_output;
 } XcbEventSource;
 
 static void xcb_enqueue_events(XcbEventSource *xcb_event_source, xcb_generic_event_t *(*poll)(xcb_connection_t *));
+static xcb_generic_event_t *xcb_dequeue_event(XcbEventSource *xcb_event_source, gint64 *arrival);
 static gboolean xcb_event_prepare(GSource *source, gint *timeout);
 static gboolean xcb_event_check(GSource *source);
 static gboolean xcb_event_dispatch(GSource *source, GSourceFunc callback, gpointer user_data);
@@ -27,34 +43,80 @@ static GSourceFuncs xcb_event_funcs = {
     xcb_event_finalize
 };
 
+static gint64 dispatch_arrival = 0;
+static gboolean dispatch_output = FALSE;
+
 GQuark
 xcb_error_quark(void)
 {
     return g_quark_from_static_string("xcb-error-quark");
 }
 
+/* Before queueing an event, the coalesce function (if any) is asked whether the
+ * last queued event can be dropped in favour of it, repeatedly.
+ */
 static void
 xcb_enqueue_events(XcbEventSource *xcb_event_source,
                    xcb_generic_event_t *(*poll)(xcb_connection_t *))
 {
     xcb_generic_event_t *event;
+    gint64 now = 0;
+    guint tail;
 
-    while (event = poll(xcb_event_source->connection))
-        g_queue_push_tail(xcb_event_source->queue, event);
+    while (xcb_event_source->length < XCB_EVENT_QUEUE_SIZE
+           && (event = poll(xcb_event_source->connection))) {
+        while (xcb_event_source->coalesce && xcb_event_source->length) {
+            tail = (xcb_event_source->head + xcb_event_source->length - 1)
+                   % XCB_EVENT_QUEUE_SIZE;
+            if (!xcb_event_source->coalesce(xcb_event_source->queue[tail], event,
+                                            xcb_event_source->coalesce_data))
+                break;
+            free(xcb_event_source->queue[tail]);
+            xcb_event_source->length--;
+        }
+        tail = (xcb_event_source->head + xcb_event_source->length++)
+               % XCB_EVENT_QUEUE_SIZE;
+        xcb_event_source->queue[tail] = event;
+        if (!now)
+            now = g_get_monotonic_time();
+        xcb_event_source->arrival[tail] = now;
+    }
+    xcb_event_source->full = xcb_event_source->length == XCB_EVENT_QUEUE_SIZE;
+}
+
+static xcb_generic_event_t *
+xcb_dequeue_event(XcbEventSource *xcb_event_source, gint64 *arrival)
+{
+    xcb_generic_event_t *event;
+
+    if (!xcb_event_source->length)
+        return NULL;
+
+    event = xcb_event_source->queue[xcb_event_source->head];
+    if (arrival)
+        *arrival = xcb_event_source->arrival[xcb_event_source->head];
+    xcb_event_source->head = (xcb_event_source->head + 1) % XCB_EVENT_QUEUE_SIZE;
+    xcb_event_source->length--;
+    return event;
 }
 
 static gboolean
 xcb_event_prepare(GSource *source, gint *timeout)
 {
     XcbEventSource *xcb_event_source = (XcbEventSource *)source;
-    
-    xcb_flush(xcb_event_source->connection);
+
+    if (xcb_event_source->pending_output) {
+        xcb_flush(xcb_event_source->connection);
+        xcb_event_source->pending_output = FALSE;
+        stats_count_flush();
+    }
 #if XCB_POLL_FOR_QUEUED_EVENT
     xcb_enqueue_events(xcb_event_source, xcb_poll_for_queued_event);
 #endif
 
-    if (g_queue_is_empty(xcb_event_source->queue)) {
-        *timeout = -1;
+    if (!xcb_event_source->length) {
+        /* Let check() pick up what did not fit in the ring last time */
+        *timeout = xcb_event_source->full ? 0 : -1;
         return FALSE;
     } else {
         *timeout = 0;
@@ -71,7 +133,7 @@ xcb_event_check(GSource *source)
         return TRUE;
 
     xcb_enqueue_events(xcb_event_source, xcb_poll_for_event);
-    return !g_queue_is_empty(xcb_event_source->queue);
+    return xcb_event_source->length > 0;
 }
 
 static gboolean
@@ -81,6 +143,7 @@ xcb_event_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
     XcbEventFunc xcb_event_callback = (XcbEventFunc)callback;
     xcb_generic_event_t *event;
     gboolean again = TRUE;
+    guint count = 0;
 
     if (!callback) {
         g_warning("XcbEvent source dispatched without a callback");
@@ -90,10 +153,19 @@ xcb_event_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
         xcb_event_callback(xcb_event_source->connection, NULL, user_data);
         return FALSE;
     }
-    while (again && (event = g_queue_pop_head(xcb_event_source->queue))) {
+    dispatch_output = FALSE;
+    while (again && (event = xcb_dequeue_event(xcb_event_source,
+                                               &dispatch_arrival))) {
         again = xcb_event_callback(xcb_event_source->connection, event, user_data);
         free(event);
+        count++;
     }
+    dispatch_arrival = 0;
+    if (dispatch_output)
+        xcb_event_source->pending_output = TRUE;
+    dispatch_output = FALSE;
+    stats_count_wakeup(STATS_WAKEUP_X);
+    stats_count_events(count);
     return again;
 }
 
@@ -101,8 +173,10 @@ static void
 xcb_event_finalize(GSource *source)
 {
     XcbEventSource *xcb_event_source = (XcbEventSource *)source;
+    xcb_generic_event_t *event;
 
-    g_queue_free_full(xcb_event_source->queue, free);
+    while (event = xcb_dequeue_event(xcb_event_source, NULL))
+        free(event);
 }
 
 GSource *
@@ -114,7 +188,7 @@ xcb_event_source_new(xcb_connection_t *connection)
     GIOCondition fd_event_mask = G_IO_IN | G_IO_HUP | G_IO_ERR;
 
     xcb_event_source->connection = connection;
-    xcb_event_source->queue = g_queue_new();
+    xcb_event_source->pending_output = TRUE;
 
 #if GLIB_CHECK_VERSION(2, 36, 0)
     g_source_add_unix_fd(source, xcb_fd, fd_event_mask);
@@ -127,8 +201,45 @@ xcb_event_source_new(xcb_connection_t *connection)
     return source;
 }
 
+void
+xcb_event_source_set_coalesce_func(GSource *source, XcbCoalesceFunc function,
+                                   gpointer data)
+{
+    XcbEventSource *xcb_event_source = (XcbEventSource *)source;
+
+    xcb_event_source->coalesce = function;
+    xcb_event_source->coalesce_data = data;
+}
+
+/* The time the event being dispatched was read from the connection; 0 when
+ * not called from an event callback.
+ */
+gint64
+xcb_event_arrival_time(void)
+{
+    return dispatch_arrival;
+}
+
+/* For event callbacks that made requests without waiting for a reply after
+ * them; the connection being dispatched is flushed before the loop sleeps.
+ * Anywhere else, this has no effect.
+ */
+void
+xcb_event_mark_output(void)
+{
+    dispatch_output = TRUE;
+}
+
 guint
 xcb_event_add(xcb_connection_t *connection, XcbEventFunc function, gpointer data)
+{
+    return xcb_event_add_full(G_PRIORITY_DEFAULT, connection, function, NULL, data);
+}
+
+guint
+xcb_event_add_full(gint priority, xcb_connection_t *connection,
+                   XcbEventFunc function, XcbCoalesceFunc coalesce,
+                   gpointer data)
 {
     guint id;
     GSource *source;
@@ -136,7 +247,11 @@ xcb_event_add(xcb_connection_t *connection, XcbEventFunc function, gpointer data
     g_return_val_if_fail(function != NULL, 0);
  
     source = xcb_event_source_new(connection);
-    g_source_set_callback(source, (GSourceFunc)function, data, NULL);
+    xcb_event_source_set_coalesce_func(source, coalesce, data);
+    g_source_set_priority(source, priority);
+    g_source_set_callback(source, (GSourceFunc)function, data,
+                          stats_source_removed);
+    stats_source_added();
     id = g_source_attach(source, NULL);
     g_source_unref(source);
 
@@ -32,11 +32,24 @@ typedef struct xcb_screensaver_notify_event_t_fixed {
 GQuark xcb_error_quark(void) G_GNUC_CONST;
 
 typedef gboolean (*XcbEventFunc)(xcb_connection_t *connection, xcb_generic_event_t *event, gpointer user_data);
+typedef gboolean (*XcbCoalesceFunc)(xcb_generic_event_t *queued, xcb_generic_event_t *event, gpointer user_data);
 
+/* The source flushes the connection after a callback that called
+ * xcb_event_mark_output(), and once after it is created; requests made from
+ * anywhere else must be flushed by the caller.
+ */
 GSource *xcb_event_source_new(xcb_connection_t *connection);
 
+void xcb_event_source_set_coalesce_func(GSource *source, XcbCoalesceFunc function, gpointer data);
+
 guint xcb_event_add(xcb_connection_t *connection, XcbEventFunc function, gpointer data);
 
+guint xcb_event_add_full(gint priority, xcb_connection_t *connection, XcbEventFunc function, XcbCoalesceFunc coalesce, gpointer data);
+
+gint64 xcb_event_arrival_time(void);
+
+void xcb_event_mark_output(void);
+
 G_END_DECLS
 
 #endif /* XCB_UTILS_H */
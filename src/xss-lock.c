@@ -2,21 +2,37 @@
  *
  * See LICENSE for the MIT license.
  */
+#include <errno.h>
 #include <locale.h>
 #include <fcntl.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <glib-unix.h>
-#include <gio/gio.h>
-#include <gio/gunixfdlist.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_aux.h>
 #include <xcb/xcb_event.h>
 #include <xcb/screensaver.h>
+#include <xcb/sync.h>
 
 #include "config.h"
+#include "backlight.h"
+#include "bus.h"
+#include "fullscreen.h"
+#include "inhibit.h"
+#include "probes.h"
+#include "settings.h"
+#include "spawn.h"
+#include "stats.h"
+#include "trace.h"
 #include "xcb_utils.h"
 
 #define LOGIND_SERVICE "org.freedesktop.login1"
@@ -24,104 +40,423 @@
 #define LOGIND_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
 #define LOGIND_SESSION_INTERFACE "org.freedesktop.login1.Session"
 
+#define STANDBY_LOCK 'L'
+#define STANDBY_MIN_LIFETIME G_USEC_PER_SEC
+
+#define RESPAWN_MIN_LIFETIME (5 * G_USEC_PER_SEC)
+#define RESPAWN_FIRST_DELAY  100    /* milliseconds */
+#define RESPAWN_MAX_DELAY    2000
+
+/* Whatever can start the locker (the X connection and the logind signals) is
+ * dispatched first; idle hint updates, statistics and configuration reloads
+ * wait until nothing else is pending.
+ */
+#define PRIORITY_LOCK         G_PRIORITY_HIGH
+#define PRIORITY_HOUSEKEEPING G_PRIORITY_LOW
+
+#define IDLETIME_COUNTER_NAME "IDLETIME"
+
+typedef struct Screen Screen;
+
+typedef struct IdleStage {
+    guint32  timeout;   /* milliseconds */
+    gchar  **cmd;       /* NULL to start the locker */
+    gchar   *path;
+} IdleStage;
+
+/* Environments are built up front, one for each way of passing a descriptor */
+typedef enum {
+    CHILD_ENV_PLAIN,
+    CHILD_ENV_SLEEP_LOCK,
+    CHILD_ENV_READY,
+    CHILD_ENV_STANDBY,
+    N_CHILD_ENVS
+} ChildEnv;
+
 typedef struct Child {
     gchar        *name;
     gchar       **cmd;
+    gchar        *path;
     GPid          pid;
     gboolean      transfer_sleep_lock_fd;
     struct Child *kill_first;
+    struct Child *standby;
+    Screen       *screen;
+    StatsTrigger  trigger;
+    gint64        trigger_time;
+    gint64        spawn_time;
+    gint          pidfd;
+    guint         watch;
+    guint         kill_timeout;
+    gboolean      respawn;          /* wanted until it exits normally */
+    gboolean      failed;           /* its last process exited abnormally */
+    guint         quick_exits;      /* abnormal exits in a row, for backoff */
+    guint         respawn_timeout;
+    GChildWatchFunc exit_func;
+    GSList       *adopted;
 } Child;
 
-static gboolean register_screensaver(xcb_connection_t *connection, xcb_screen_t *screen, xcb_atom_t *atom, GError **error);
-static void unregister_screensaver(xcb_connection_t *connection, xcb_screen_t *screen, xcb_atom_t atom);
-static gboolean screensaver_event_cb(xcb_connection_t *connection, xcb_generic_event_t *event, const int *xcb_screensaver_notify);
+/* A descendant of a child, reparented to us when its parent exited */
+typedef struct Adopted {
+    GPid   pid;
+    gint   pidfd;
+    guint  watch;
+    Child *child;
+} Adopted;
+
+/* Everything that belongs to one X display: with --attach, a single process
+ * serves any number of them, each with its own children and login session.
+ */
+struct Screen {
+    guint             index;
+    gchar            *display;
+    gchar            *session_id;
+    gchar           **env[N_CHILD_ENVS];
+    xcb_connection_t *connection;
+    xcb_screen_t     *xcb_screen;
+    xcb_atom_t        atom;
+    xcb_atom_t        wm_pid_atom;
+    int               screensaver_notify;
+    gboolean          suspendable;
+    gboolean          saver_suspended;
+    gboolean          lost;
+    Child             notifier;
+    Child             locker;
+    Child             standby;
+    gint              standby_fd;
+    gint64            standby_start_time;
+    gint              ready_fd;
+    guint             ready_watch;
+    gboolean          watching_windows;
+    GSList           *new_windows;
+    gchar            *session_path;
+    guint             lock_subscription;
+    guint             unlock_subscription;
+    gboolean          idle_hint;
+    gboolean          idle_hint_wanted;
+    gboolean          idle_hint_sent;
+    guint             idle_hint_call;
+    guint             idle_hint_delay;
+    Backlight        *backlight;
+    Fullscreen       *fullscreen;
+    int               sync_notify;
+    xcb_sync_alarm_t  idle_reset_alarm;
+    xcb_sync_alarm_t *idle_alarms;
+    Child            *idle_children;
+};
+
+static Screen *screen_new(const gchar *display, const gchar *session_id);
+static void screen_free(Screen *screen);
+static gboolean screen_connect(Screen *screen, GError **error);
+
+static gboolean register_screensaver(Screen *screen, GError **error);
+static void unregister_screensaver(Screen *screen);
+static gboolean screensaver_event_cb(xcb_connection_t *connection, xcb_generic_event_t *event, Screen *screen);
+static void force_screen_saver(xcb_connection_t *connection, uint8_t mode);
+static gboolean screensaver_event_coalesce(xcb_generic_event_t *queued, xcb_generic_event_t *event, Screen *screen);
+static gboolean register_idle_alarms(Screen *screen, GError **error);
+static void unregister_idle_alarms(Screen *screen);
+static void idle_alarm_cb(Screen *screen, xcb_sync_alarm_notify_event_t *event);
+static void kill_idle_children(Screen *screen);
+static gboolean has_notifier(Screen *screen);
+static void start_notifier(Screen *screen);
+static void stop_notifier(Screen *screen);
 
-static void keep_sleep_lock_fd_open(gpointer user_data);
 static void start_child(Child *child);
+static guint8 child_id(Child *child);
+static Child *child_by_id(Screen *screen, guint8 id);
+static gint64 lock_trigger_time(StatsTrigger trigger, gint64 arrival);
+static void start_locker(Screen *screen, StatsTrigger trigger, gint64 trigger_time);
+static void use_locker_for(Child *locker, StatsTrigger trigger);
 static void kill_child(Child *child);
+static void watch_child(Child *child, GChildWatchFunc func);
+static gboolean reap(GPid pid, gint *status);
+static gboolean child_pidfd_cb(gint fd, GIOCondition condition, Child *child);
+static void child_exited(Child *child);
+static gboolean kill_child_timeout_cb(Child *child);
+static void signal_child(Child *child, gint signal);
+static gboolean child_running(Child *child);
+static void child_finished(Child *child);
+static gboolean exit_abnormal(gint status);
+static void respawn_child(Child *child);
+static gboolean respawn_timeout_cb(Child *child);
+static void adopt_orphans(Child *child);
+static gboolean orphan_of_screen(GPid orphan, Screen *screen);
+static gboolean adopted_pidfd_cb(gint fd, GIOCondition condition, Adopted *adopted);
+static void adopted_watch_cb(GPid pid, gint status, Adopted *adopted);
 static void child_watch_cb(GPid pid, gint status, Child *child);
-
-static void logind_manager_proxy_new_cb(GObject *source_object, GAsyncResult *res, gpointer user_data);
-static void logind_manager_take_sleep_delay_lock(void);
-static void logind_manager_call_inhibit_cb(GObject *source_object, GAsyncResult *res, gpointer user_data);
-static void logind_manager_on_signal_prepare_for_sleep(GDBusProxy *proxy, gchar *sender_name, gchar *signal_name, GVariant *parameters, gpointer user_data);
-static void logind_manager_call_get_session_cb(GObject *source_object, GAsyncResult *res, gpointer user_data);
-static void logind_session_proxy_new_cb(GObject *source_object, GAsyncResult *res, gpointer user_data);
-static void logind_session_on_signal_lock(GDBusProxy *proxy, gchar *sender_name, gchar *signal_name, GVariant *parameters, gpointer user_data);
-static void logind_session_set_idle_hint(gboolean idle);
+static void start_standby(Child *standby);
+static gboolean activate_standby(Child *child);
+static void standby_watch_cb(GPid pid, gint status, Child *standby);
+
+static void wait_for_lockers(void);
+static gboolean lockers_pending(void);
+static void stop_waiting_for_locker(Screen *screen);
+static gboolean locker_ready_cb(gint fd, GIOCondition condition, Screen *screen);
+static gboolean locker_ready_timeout_cb(gpointer user_data);
+static void watch_locker_windows(Screen *screen, gboolean watch);
+static void locker_window_event(Screen *screen, xcb_generic_event_t *event);
+static gboolean locker_window_covers(Screen *screen, xcb_window_t window);
+static gboolean child_owns_pid(Child *child, GPid pid);
+static void release_sleep_lock(void);
+static void set_sleep_nice(gboolean sleeping);
+
+static void system_bus_get_cb(Bus *bus, const GError *error, gpointer user_data);
+static void startup_step_done(void);
+static void notify_ready(void);
+static void logind_manager_watch_sleep(gboolean watch, gboolean startup);
+static void logind_manager_take_sleep_delay_lock(gboolean startup);
+static void logind_manager_call_inhibit_cb(Bus *bus, GVariant *reply, gint fd, const GError *error, gpointer user_data);
+static void logind_manager_on_signal_prepare_for_sleep(Bus *bus, const gchar *member, GVariant *parameters, gpointer user_data);
+static void logind_manager_get_session(Screen *screen);
+static void logind_manager_call_get_session_cb(Bus *bus, GVariant *reply, gint fd, const GError *error, gpointer user_data);
+static void logind_session_on_signal_lock(Bus *bus, const gchar *member, GVariant *parameters, gpointer user_data);
+static void logind_session_set_idle_hint(Screen *screen, gboolean idle);
+static gboolean logind_session_idle_hint_delay_cb(Screen *screen);
+static void logind_session_send_idle_hint(Screen *screen);
+static void logind_session_call_set_idle_hint_cb(Bus *bus, GVariant *reply, gint fd, const GError *error, gpointer user_data);
+static void logind_session_cancel_idle_hint(Screen *screen);
+
+static gboolean screen_inhibited(Screen *screen);
+static void update_inhibit(Screen *screen);
+static void inhibit_changed_cb(gboolean inhibited, gpointer user_data);
 
 static gboolean parse_options(int argc, char *argv[], GError **error);
 static gboolean parse_notifier_cmd(const gchar *option_name, const gchar *value, gpointer data, GError **error);
-static gboolean reset_screensaver(xcb_connection_t *connection);
+static gboolean parse_dim(const gchar *option_name, const gchar *value, gpointer data, GError **error);
+static gboolean parse_inhibit_fullscreen(const gchar *option_name, const gchar *value, gpointer data, GError **error);
+static gboolean parse_trigger_locker(const gchar *option_name, const gchar *value, gpointer data, GError **error);
+static gboolean parse_idle_stage(const gchar *option_name, const gchar *value, gpointer data, GError **error);
+static gint compare_idle_stages(gconstpointer a, gconstpointer b);
+static gboolean reset_screensaver(Screen *screen);
+static gboolean dump_stats(gpointer user_data);
+static void watch_config(void);
+static gboolean config_changed_cb(gint fd, GIOCondition condition, gpointer user_data);
+static gboolean reload_config(gpointer user_data);
+static void load_config(void);
+static void apply_settings(Settings *new_settings);
+static gboolean cmd_equal(gchar **a, gchar **b);
 static gboolean exit_service(GMainLoop *loop);
+static gboolean replay(GMainLoop *loop, GError **error);
+static gboolean replay_record(GMainLoop *loop, Screen *screen, const TraceRecord *record);
+static void replay_screen_setup(Screen *screen);
+static void replay_action(Screen *screen, const gchar *format, ...) G_GNUC_PRINTF(2, 3);
 static void log_handler(const gchar *log_domain, GLogLevelFlags log_level, const gchar *message, gpointer user_data);
 
-static Child notifier = {"notifier", NULL, 0, FALSE, NULL};
-static Child locker = {"locker", NULL, 0, FALSE, &notifier};
+static gint dim_duration = -1;
+static BacklightCurve dim_curve = BACKLIGHT_CURVE_LINEAR;
 static gboolean opt_quiet = FALSE;
 static gboolean opt_verbose = FALSE;
-static gboolean opt_ignore_sleep = FALSE;
+static gboolean opt_standby = FALSE;
+static gint opt_sleep_nice = G_MAXINT;
+static gboolean opt_inhibit_service = FALSE;
+static gboolean opt_inhibit_fullscreen = FALSE;
+static gchar **fullscreen_classes = NULL;
 static gboolean opt_print_version = FALSE;
 static gchar *opt_session = NULL;
+static gchar *opt_stats_file = NULL;
+static gchar *opt_config = NULL;
+static gchar *opt_record = NULL;
+static gchar *opt_replay = NULL;
+static gchar **opt_attach = NULL;
+static GArray *idle_stages = NULL;
+static Settings cmdline_settings = {
+    .ready_timeout = 2000, .kill_timeout = 2000, .idle_hint_delay = 500
+};
+static Settings *settings = NULL;
 
 static GOptionEntry opt_entries[] = {
-    {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &locker.cmd, NULL, "LOCK_CMD [ARG...]"},
+    {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &cmdline_settings.locker_cmd, NULL, "LOCK_CMD [ARG...]"},
     {"notifier", 'n', G_OPTION_FLAG_FILENAME, G_OPTION_ARG_CALLBACK, parse_notifier_cmd, "Send notification using CMD", "CMD"},
-    {"transfer-sleep-lock", 'l', 0, G_OPTION_ARG_NONE, &locker.transfer_sleep_lock_fd, "Pass sleep delay lock file descriptor to locker", NULL},
-    {"ignore-sleep", 0, 0, G_OPTION_ARG_NONE, &opt_ignore_sleep, "Do not lock on suspend/hibernate", NULL},
+    {"dim", 0, 0, G_OPTION_ARG_CALLBACK, parse_dim, "Fade out the backlight over MS milliseconds before locking", "MS[:CURVE]"},
+    {"transfer-sleep-lock", 'l', 0, G_OPTION_ARG_NONE, &cmdline_settings.transfer_sleep_lock, "Pass sleep delay lock file descriptor to locker", NULL},
+    {"ignore-sleep", 0, 0, G_OPTION_ARG_NONE, &cmdline_settings.ignore_sleep, "Do not lock on suspend/hibernate", NULL},
+#if !WITH_LEAN_DBUS
+    {"inhibit-service", 0, 0, G_OPTION_ARG_NONE, &opt_inhibit_service, "Provide the org.freedesktop.ScreenSaver inhibit interface", NULL},
+#endif
+    {"inhibit-fullscreen", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK, parse_inhibit_fullscreen, "Do not lock while a fullscreen window (of a listed WM_CLASS) has focus", "CLASS[,CLASS...]"},
+    {"standby", 0, 0, G_OPTION_ARG_NONE, &opt_standby, "Keep a locker waiting to be activated", NULL},
+    {"kill-timeout", 0, 0, G_OPTION_ARG_INT, &cmdline_settings.kill_timeout, "Send SIGKILL to children that are still running MS milliseconds after SIGTERM", "MS"},
+    {"idle-hint-delay", 0, 0, G_OPTION_ARG_INT, &cmdline_settings.idle_hint_delay, "Update the session's idle hint only once it has been stable for MS milliseconds", "MS"},
+    {"ready-timeout", 0, 0, G_OPTION_ARG_INT, &cmdline_settings.ready_timeout, "Delay sleep at most MS milliseconds for the locker to be ready", "MS"},
+    {"sleep-nice", 0, 0, G_OPTION_ARG_INT, &opt_sleep_nice, "Run at nice value N while sleep waits for the locker", "N"},
     {"quiet", 'q', 0, G_OPTION_ARG_NONE, &opt_quiet, "Output only fatal errors", NULL},
     {"verbose", 'v', 0, G_OPTION_ARG_NONE, &opt_verbose, "Output more messages", NULL},
     {"version", 0, 0, G_OPTION_ARG_NONE, &opt_print_version, "Print version number and exit", NULL},
     {"session", 's', 0, G_OPTION_ARG_STRING, &opt_session, "Use ID instead of the current session", "ID"},
+    {"locker-for", 0, 0, G_OPTION_ARG_CALLBACK, parse_trigger_locker, "Lock with CMD instead when triggered by TRIGGER (repeatable)", "TRIGGER[,l]:CMD"},
+    {"idle-stage", 0, 0, G_OPTION_ARG_CALLBACK, parse_idle_stage, "Run CMD (or the locker, if omitted) after SECS of inactivity (repeatable)", "SECS[:CMD]"},
+    {"attach", 0, 0, G_OPTION_ARG_STRING_ARRAY, &opt_attach, "Serve X display DISPLAY in login session ID (repeatable)", "DISPLAY[,ID]"},
+    {"stats-file", 0, 0, G_OPTION_ARG_FILENAME, &opt_stats_file, "Write statistics to FILE on SIGUSR2", "FILE"},
+    {"config", 'c', 0, G_OPTION_ARG_FILENAME, &opt_config, "Read settings from FILE, and again whenever it changes", "FILE"},
+    {"record", 0, 0, G_OPTION_ARG_FILENAME, &opt_record, "Record every input to trace FILE", "FILE"},
+    {"replay", 0, 0, G_OPTION_ARG_FILENAME, &opt_replay, "Replay trace FILE without running anything and report the actions taken", "FILE"},
     {NULL}
 };
 
-static GDBusProxy *logind_manager = NULL;
-static GDBusProxy *logind_session = NULL;
+static const gchar *const child_env_variables[N_CHILD_ENVS] = {
+    NULL, "XSS_SLEEP_LOCK_FD", "XSS_READY_FD", "XSS_STANDBY_FD"
+};
+
+static GSList *screens = NULL;
+static GHashTable *tracked_pids = NULL;
+static gboolean subreaper = FALSE;
+static Bus *system_bus = NULL;
+static guint prepare_for_sleep_subscription = 0;
 static gint sleep_lock_fd = -1;
+static gint64 sleep_trigger_time = 0;
 static gboolean preparing_for_sleep = FALSE;
+static guint ready_timeout = 0;
+static gint64 start_time = 0;
+static gint base_nice = 0;
+static gchar *notify_socket = NULL;
+static guint startup_pending = 0;
+static gint config_watch_fd = -1;
+static guint config_watch = 0;
+static gint64 replay_start_time = 0;
+
+static Screen *
+screen_new(const gchar *display, const gchar *session_id)
+{
+    Screen *screen = g_new0(Screen, 1);
+    guint i;
+
+    screen->index = g_slist_length(screens);
+    screen->display = g_strdup(display);
+    screen->session_id = g_strdup(session_id);
+    screen->env[CHILD_ENV_PLAIN] = g_get_environ();
+    if (display)
+        screen->env[CHILD_ENV_PLAIN] =
+            g_environ_setenv(screen->env[CHILD_ENV_PLAIN], "DISPLAY", display, TRUE);
+    for (i = CHILD_ENV_PLAIN + 1; i < N_CHILD_ENVS; i++)
+        screen->env[i] = spawn_environ(screen->env[CHILD_ENV_PLAIN],
+                                       child_env_variables[i]);
+
+    screen->notifier.name = "notifier";
+    screen->notifier.cmd = settings->notifier_cmd;
+    screen->notifier.path = settings->notifier_path;
+    screen->notifier.screen = screen;
+
+    screen->locker.name = "locker";
+    screen->locker.cmd = settings->locker_cmd;
+    screen->locker.path = settings->locker_path;
+    screen->locker.transfer_sleep_lock_fd = settings->transfer_sleep_lock;
+    screen->locker.kill_first = &screen->notifier;
+    screen->locker.screen = screen;
+
+    screen->standby.name = "standby locker";
+    screen->standby.cmd = settings->locker_cmd;
+    screen->standby.path = settings->locker_path;
+    screen->standby.screen = screen;
+
+    screen->standby_fd = -1;
+    screen->ready_fd = -1;
+
+    if (idle_stages) {
+        screen->idle_children = g_new0(Child, idle_stages->len);
+        for (i = 0; i < idle_stages->len; i++) {
+            IdleStage *stage = &g_array_index(idle_stages, IdleStage, i);
+
+            screen->idle_children[i].name = g_strdup_printf("idle stage %u", i + 1);
+            screen->idle_children[i].cmd = stage->cmd;
+            screen->idle_children[i].path = stage->path;
+            screen->idle_children[i].screen = screen;
+        }
+    }
+    return screen;
+}
+
+static void
+screen_free(Screen *screen)
+{
+    guint i;
+
+    stop_waiting_for_locker(screen);
+    logind_session_cancel_idle_hint(screen);
+    if (screen->standby_fd >= 0) close(screen->standby_fd);
+    if (screen->lock_subscription)
+        bus_unsubscribe(system_bus, screen->lock_subscription);
+    if (screen->unlock_subscription)
+        bus_unsubscribe(system_bus, screen->unlock_subscription);
+    g_free(screen->session_path);
+    if (screen->backlight) backlight_free(screen->backlight);
+    if (screen->fullscreen) fullscreen_free(screen->fullscreen);
+    if (screen->connection) xcb_disconnect(screen->connection);
+    if (screen->idle_children) {
+        for (i = 0; i < idle_stages->len; i++)
+            g_free(screen->idle_children[i].name);
+        g_free(screen->idle_children);
+    }
+    g_free(screen->idle_alarms);
+    for (i = 0; i < N_CHILD_ENVS; i++)
+        g_strfreev(screen->env[i]);
+    g_free(screen->session_id);
+    g_free(screen->display);
+    g_free(screen);
+}
+
+static gboolean
+screen_connect(Screen *screen, GError **error)
+{
+    int screen_number;
+
+    screen->connection = xcb_connect(screen->display, &screen_number);
+    if (xcb_connection_has_error(screen->connection)) {
+        g_set_error(error, XCB_ERROR, 0, "Connecting to X server %s failed",
+                    screen->display ? screen->display : "");
+        return FALSE;
+    }
+    screen->xcb_screen = xcb_aux_get_screen(screen->connection, screen_number);
+    return TRUE;
+}
 
 static gboolean
-register_screensaver(xcb_connection_t *connection, xcb_screen_t *screen,
-                     xcb_atom_t *atom, GError **error)
+register_screensaver(Screen *screen, GError **error)
 {
+    xcb_connection_t *connection = screen->connection;
+    xcb_screen_t *xcb_screen = screen->xcb_screen;
     uint32_t xid;
     const xcb_query_extension_reply_t *extension_reply;
     xcb_screensaver_query_version_cookie_t version_cookie;
     xcb_screensaver_query_version_reply_t *version_reply = NULL;
-    xcb_intern_atom_cookie_t atom_cookie;
-    xcb_intern_atom_reply_t *atom_reply = NULL;
+    xcb_intern_atom_cookie_t atom_cookie, wm_pid_cookie;
+    xcb_intern_atom_reply_t *atom_reply = NULL, *wm_pid_reply = NULL;
     xcb_void_cookie_t set_attributes_cookie;
     xcb_generic_error_t *xcb_error = NULL;
 
     xcb_prefetch_extension_data(connection, &xcb_screensaver_id);
     xid = xcb_generate_id(connection);
-    xcb_create_pixmap(connection, screen->root_depth, xid, screen->root, 1, 1);
+    xcb_create_pixmap(connection, xcb_screen->root_depth, xid, xcb_screen->root, 1, 1);
     atom_cookie = xcb_intern_atom(connection, FALSE,
                                   strlen(XCB_SCREENSAVER_PROPERTY_NAME),
                                   XCB_SCREENSAVER_PROPERTY_NAME);
+    wm_pid_cookie = xcb_intern_atom(connection, FALSE, strlen("_NET_WM_PID"),
+                                    "_NET_WM_PID");
     extension_reply = xcb_get_extension_data(connection, &xcb_screensaver_id);
     if (!extension_reply || !extension_reply->present) {
         g_set_error(error, XCB_ERROR, 0, "Screensaver extension unavailable");
         goto out;
     }
 
-    version_cookie = xcb_screensaver_query_version(connection, 1, 0);
+    version_cookie = xcb_screensaver_query_version(connection, 1, 1);
     set_attributes_cookie =
-        xcb_screensaver_set_attributes_checked(connection, screen->root,
+        xcb_screensaver_set_attributes_checked(connection, xcb_screen->root,
                                                -1, -1, 1, 1, 0,
                                                XCB_COPY_FROM_PARENT,
                                                XCB_COPY_FROM_PARENT,
                                                XCB_COPY_FROM_PARENT,
                                                0, NULL);
 
-    xcb_screensaver_select_input(connection, screen->root,
+    xcb_screensaver_select_input(connection, xcb_screen->root,
                                  XCB_SCREENSAVER_EVENT_NOTIFY_MASK |
                                  XCB_SCREENSAVER_EVENT_CYCLE_MASK);
 
     version_reply = xcb_screensaver_query_version_reply(connection,
                                                         version_cookie,
                                                         &xcb_error);
+    screen->suspendable = version_reply
+        && (version_reply->server_major_version > 1
+            || version_reply->server_minor_version >= 1);
     if (xcb_error = xcb_request_check(connection, set_attributes_cookie)) {
         g_set_error(error, XCB_ERROR, 0, "Failed to set screensaver attributes; "
                                          "is another one running?");
@@ -129,16 +464,21 @@ register_screensaver(xcb_connection_t *connection, xcb_screen_t *screen,
     }
 
     atom_reply = xcb_intern_atom_reply(connection, atom_cookie, &xcb_error);
-    *atom = atom_reply->atom;
-    xcb_change_property(connection, XCB_PROP_MODE_REPLACE, screen->root,
-                        *atom, XCB_ATOM_PIXMAP, 32, 1, &xid);
+    screen->atom = atom_reply->atom;
+    xcb_change_property(connection, XCB_PROP_MODE_REPLACE, xcb_screen->root,
+                        screen->atom, XCB_ATOM_PIXMAP, 32, 1, &xid);
+    if ((wm_pid_reply = xcb_intern_atom_reply(connection, wm_pid_cookie, NULL)))
+        screen->wm_pid_atom = wm_pid_reply->atom;
 
-    xcb_event_add(connection, (XcbEventFunc)screensaver_event_cb,
-                  (void *)&extension_reply->first_event);
+    screen->screensaver_notify = extension_reply->first_event;
+    xcb_event_add_full(PRIORITY_LOCK, connection,
+                       (XcbEventFunc)screensaver_event_cb,
+                       (XcbCoalesceFunc)screensaver_event_coalesce, screen);
 
 out:
     if (version_reply) free(version_reply);
     if (atom_reply) free(atom_reply);
+    if (wm_pid_reply) free(wm_pid_reply);
     if (xcb_error) {
         free(xcb_error);
         return FALSE;
@@ -147,31 +487,67 @@ out:
 }
 
 static void
-unregister_screensaver(xcb_connection_t *connection, xcb_screen_t *screen,
-                       xcb_atom_t atom)
+unregister_screensaver(Screen *screen)
+{
+    xcb_screensaver_unset_attributes(screen->connection, screen->xcb_screen->root);
+    xcb_delete_property(screen->connection, screen->xcb_screen->root, screen->atom);
+}
+
+/* For event callbacks, where the source does the flushing */
+static void
+force_screen_saver(xcb_connection_t *connection, uint8_t mode)
 {
-    xcb_screensaver_unset_attributes(connection, screen->root);
-    xcb_delete_property(connection, screen->root, atom);
+    xcb_force_screen_saver(connection, mode);
+    xcb_event_mark_output();
 }
 
 static gboolean
 screensaver_event_cb(xcb_connection_t *connection, xcb_generic_event_t *event,
-                     const int *const xcb_screensaver_notify)
+                     Screen *screen)
 {
+    gint64 arrival = xcb_event_arrival_time();
     uint8_t event_type;
     
-    if (!event)
-        g_critical("X connection lost; exiting.");
+    if (!event) {
+        if (!opt_attach)
+            g_critical("X connection lost; exiting.");
+
+        /* Other displays served by this process carry on */
+        g_warning("X connection to %s lost; detaching", screen->display);
+        screen->lost = TRUE;
+        logind_session_cancel_idle_hint(screen);
+        stop_notifier(screen);
+        kill_child(&screen->locker);
+        kill_child(&screen->standby);
+        kill_idle_children(screen);
+        return FALSE;
+    }
     
     event_type = XCB_EVENT_RESPONSE_TYPE(event);
     if (event_type == 0) {
         xcb_generic_error_t *error = (xcb_generic_error_t *)event;
 
         g_warning("X error: %s", xcb_event_get_error_label(error->error_code));
-    } else if (event_type == *xcb_screensaver_notify) {
+    } else if (screen->idle_alarms
+               && event_type == screen->sync_notify + XCB_SYNC_ALARM_NOTIFY) {
+        idle_alarm_cb(screen, (xcb_sync_alarm_notify_event_t *)event);
+    } else if (screen->watching_windows
+               && (event_type == XCB_CREATE_NOTIFY
+                   || event_type == XCB_DESTROY_NOTIFY
+                   || event_type == XCB_MAP_NOTIFY)) {
+        locker_window_event(screen, event);
+    } else if (screen->fullscreen && event_type == XCB_PROPERTY_NOTIFY) {
+        if (fullscreen_handle_event(screen->fullscreen,
+                                    (xcb_property_notify_event_t *)event))
+            update_inhibit(screen);
+    } else if (event_type == screen->screensaver_notify) {
         xcb_screensaver_notify_event_t *xss_event =
             (xcb_screensaver_notify_event_t *)event;
 
+        PROBE4(saver_event, xss_event->state, xss_event->kind,
+               xss_event->forced, screen->display ? screen->display : "");
+        trace_record(TRACE_INPUT_SAVER, screen->index, xss_event->state,
+                     xss_event->kind, xss_event->forced, 0);
         switch (xss_event->state) {
         case XCB_SCREENSAVER_STATE_ON:
             if (xss_event->kind == XCB_SCREENSAVER_KIND_INTERNAL)
@@ -181,23 +557,27 @@ screensaver_event_cb(xcb_connection_t *connection, xcb_generic_event_t *event,
                  * grabbed when the saver activates, but Xorg does not seem to
                  * work that way; I'm leaving this in anyway.
                  */
-                xcb_force_screen_saver(connection, XCB_SCREEN_SAVER_ACTIVE);
-            else if (!notifier.cmd || xss_event->forced) {
-                start_child(&locker);
-                logind_session_set_idle_hint(TRUE);
-            } else if (!locker.pid)
-                start_child(&notifier);
+                force_screen_saver(connection, XCB_SCREEN_SAVER_ACTIVE);
+            else if (!xss_event->forced && screen_inhibited(screen))
+                force_screen_saver(connection, XCB_SCREEN_SAVER_RESET);
+            else if (!has_notifier(screen) || xss_event->forced) {
+                start_locker(screen, STATS_TRIGGER_SAVER,
+                             lock_trigger_time(STATS_TRIGGER_SAVER, arrival));
+                logind_session_set_idle_hint(screen, TRUE);
+            } else if (!child_running(&screen->locker))
+                start_notifier(screen);
             else
-                logind_session_set_idle_hint(TRUE);
+                logind_session_set_idle_hint(screen, TRUE);
             break;
         case XCB_SCREENSAVER_STATE_OFF:
-            kill_child(&notifier);
-            logind_session_set_idle_hint(FALSE);
+            stop_notifier(screen);
+            logind_session_set_idle_hint(screen, FALSE);
             break;
         case XCB_SCREENSAVER_STATE_CYCLE:
-            if (!locker.pid) {
-                logind_session_set_idle_hint(TRUE);
-                start_child(&locker);
+            if (!child_running(&screen->locker) && !screen_inhibited(screen)) {
+                logind_session_set_idle_hint(screen, TRUE);
+                start_locker(screen, STATS_TRIGGER_CYCLE,
+                             lock_trigger_time(STATS_TRIGGER_CYCLE, arrival));
             }
             break;
         }
@@ -205,350 +585,2095 @@ screensaver_event_cb(xcb_connection_t *connection, xcb_generic_event_t *event,
     return TRUE;
 }
 
-static void
-keep_sleep_lock_fd_open(gpointer user_data)
-{
-    fcntl(sleep_lock_fd, F_SETFD, ~FD_CLOEXEC & fcntl(sleep_lock_fd, F_GETFD));
-}
-
-static void
-start_child(Child *child)
+/* A burst of notifications (e.g., from an `xset s reset` loop) collapses into
+ * its net state, but never at the cost of one that would start the locker.
+ */
+static gboolean
+screensaver_event_coalesce(xcb_generic_event_t *queued,
+                           xcb_generic_event_t *event, Screen *screen)
 {
-    GSpawnFlags flags = G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD;
-    GSpawnChildSetupFunc setup = NULL;
-    gchar **env = NULL;
-    GError *error = NULL;
-
-    if (child->pid)
-        return;
+    xcb_screensaver_notify_event_t *xss_event =
+        (xcb_screensaver_notify_event_t *)queued;
+    gboolean drop;
 
-    if (child->kill_first)
-        kill_child(child->kill_first);
+    if (XCB_EVENT_RESPONSE_TYPE(queued) != screen->screensaver_notify
+        || XCB_EVENT_RESPONSE_TYPE(event) != screen->screensaver_notify)
+        return FALSE;
 
-    if (preparing_for_sleep && child->transfer_sleep_lock_fd) {
-        gchar *fd = g_strdup_printf("%d", sleep_lock_fd);
-        env = g_environ_setenv(g_get_environ(), "XSS_SLEEP_LOCK_FD", fd, TRUE);
-        g_free(fd);
+    switch (xss_event->state) {
+    case XCB_SCREENSAVER_STATE_OFF:
+        drop = TRUE;
+        break;
+    case XCB_SCREENSAVER_STATE_ON:
+        drop = has_notifier(screen) && !xss_event->forced
+               && xss_event->kind != XCB_SCREENSAVER_KIND_INTERNAL;
+        break;
+    default:
+        drop = FALSE;
+        break;
+    }
+    if (drop)
+        PROBE2(saver_coalesce, xss_event->state,
+               ((xcb_screensaver_notify_event_t *)event)->state);
+    return drop;
+}
 
-        flags |= G_SPAWN_LEAVE_DESCRIPTORS_OPEN;
-        setup = keep_sleep_lock_fd_open;
+/* Each idle stage is an XSync alarm on the server's IDLETIME counter that
+ * triggers when the counter passes the stage's timeout, so nothing needs to
+ * poll. One more alarm, on the counter dropping back below the first timeout,
+ * reports renewed activity.
+ */
+static gboolean
+register_idle_alarms(Screen *screen, GError **error)
+{
+    xcb_connection_t *connection = screen->connection;
+    const xcb_query_extension_reply_t *extension_reply;
+    xcb_sync_initialize_cookie_t initialize_cookie;
+    xcb_sync_initialize_reply_t *initialize_reply = NULL;
+    xcb_sync_list_system_counters_cookie_t counters_cookie;
+    xcb_sync_list_system_counters_reply_t *counters_reply = NULL;
+    xcb_sync_systemcounter_iterator_t iter;
+    xcb_sync_counter_t idletime = XCB_NONE;
+    guint i;
+
+    extension_reply = xcb_get_extension_data(connection, &xcb_sync_id);
+    if (!extension_reply || !extension_reply->present) {
+        g_set_error(error, XCB_ERROR, 0, "Sync extension unavailable");
+        return FALSE;
     }
+    screen->sync_notify = extension_reply->first_event;
+
+    initialize_cookie = xcb_sync_initialize(connection, 3, 1);
+    counters_cookie = xcb_sync_list_system_counters(connection);
+    initialize_reply = xcb_sync_initialize_reply(connection, initialize_cookie, NULL);
+    counters_reply = xcb_sync_list_system_counters_reply(connection,
+                                                         counters_cookie, NULL);
+    if (!initialize_reply || !counters_reply)
+        goto out;
 
-    if (!g_spawn_async(NULL, child->cmd, env, flags, setup, NULL, &child->pid, &error)) {
-        g_warning("Error spawning %s: %s", child->name, error->message);
-        g_error_free(error);
+    for (iter = xcb_sync_list_system_counters_counters_iterator(counters_reply);
+         iter.rem; xcb_sync_systemcounter_next(&iter)) {
+        if (xcb_sync_systemcounter_name_length(iter.data) == strlen(IDLETIME_COUNTER_NAME)
+            && !strncmp(xcb_sync_systemcounter_name(iter.data), IDLETIME_COUNTER_NAME,
+                        strlen(IDLETIME_COUNTER_NAME))) {
+            idletime = iter.data->counter;
+            break;
+        }
+    }
+    if (idletime == XCB_NONE)
         goto out;
+
+    screen->idle_alarms = g_new(xcb_sync_alarm_t, idle_stages->len);
+    for (i = 0; i <= idle_stages->len; i++) {
+        const IdleStage *stage = &g_array_index(idle_stages, IdleStage,
+                                                i < idle_stages->len ? i : 0);
+        uint32_t values[] = {
+            idletime,
+            XCB_SYNC_VALUETYPE_ABSOLUTE,
+            0, stage->timeout,
+            i < idle_stages->len ? XCB_SYNC_TESTTYPE_POSITIVE_TRANSITION
+                                 : XCB_SYNC_TESTTYPE_NEGATIVE_TRANSITION,
+            0, 0,
+            TRUE
+        };
+        xcb_sync_alarm_t alarm = xcb_generate_id(connection);
+
+        xcb_sync_create_alarm(connection, alarm,
+                              XCB_SYNC_CA_COUNTER | XCB_SYNC_CA_VALUE_TYPE |
+                              XCB_SYNC_CA_VALUE | XCB_SYNC_CA_TEST_TYPE |
+                              XCB_SYNC_CA_DELTA | XCB_SYNC_CA_EVENTS, values);
+        if (i < idle_stages->len)
+            screen->idle_alarms[i] = alarm;
+        else
+            screen->idle_reset_alarm = alarm;
     }
-    g_child_watch_add(child->pid, (GChildWatchFunc)child_watch_cb, child);
 
 out:
-    g_strfreev(env);
+    if (initialize_reply) free(initialize_reply);
+    if (counters_reply) free(counters_reply);
+    if (!screen->idle_alarms) {
+        g_set_error(error, XCB_ERROR, 0, "Idle time counter unavailable");
+        return FALSE;
+    }
+    return TRUE;
 }
 
 static void
-kill_child(Child *child)
+unregister_idle_alarms(Screen *screen)
 {
-    if (child->pid && kill(child->pid, SIGTERM))
-        g_warning("Error sending SIGTERM to %s: %s", child->name, g_strerror(errno));
+    guint i;
+
+    if (!screen->idle_alarms)
+        return;
+    for (i = 0; i < idle_stages->len; i++)
+        xcb_sync_destroy_alarm(screen->connection, screen->idle_alarms[i]);
+    xcb_sync_destroy_alarm(screen->connection, screen->idle_reset_alarm);
 }
 
 static void
-child_watch_cb(GPid pid, gint status, Child *child)
+idle_alarm_cb(Screen *screen, xcb_sync_alarm_notify_event_t *event)
 {
-#if GLIB_CHECK_VERSION(2, 34, 0)
-    GError *error = NULL;
+    guint i;
 
-    if (!g_spawn_check_exit_status(status, &error)) {
-        g_message("%s exited abnormally: %s", child->name, error->message);
-        g_error_free(error);
+    if (event->alarm == screen->idle_reset_alarm) {
+        trace_record(TRACE_INPUT_IDLE_ALARM, screen->index, TRACE_IDLE_RESET, 0, 0, 0);
+        kill_idle_children(screen);
+        return;
+    }
+
+    for (i = 0; i < idle_stages->len; i++) {
+        if (event->alarm != screen->idle_alarms[i])
+            continue;
+        trace_record(TRACE_INPUT_IDLE_ALARM, screen->index, i, 0, 0, 0);
+        if (screen_inhibited(screen))
+            break;
+
+        g_debug("Idle for %u ms", g_array_index(idle_stages, IdleStage, i).timeout);
+        logind_session_set_idle_hint(screen, TRUE);
+        if (screen->idle_children[i].cmd)
+            start_child(&screen->idle_children[i]);
+        else if (!child_running(&screen->locker))
+            start_locker(screen, STATS_TRIGGER_IDLE, trace_now());
+        break;
     }
-#endif
-    child->pid = 0;
-    g_spawn_close_pid(pid);
 }
 
 static void
-logind_manager_proxy_new_cb(GObject *source_object, GAsyncResult *res,
-                            gpointer user_data)
+kill_idle_children(Screen *screen)
 {
-    GError *error = NULL;
-
-    logind_manager = g_dbus_proxy_new_for_bus_finish(res, &error);
-
-    if (!logind_manager) {
-        g_warning("Error connecting to systemd login manager: %s", error->message);
-        g_error_free(error);
-        return;
-    }
-    if (!opt_ignore_sleep) {
-        g_signal_connect(logind_manager, "g-signal",
-                         G_CALLBACK(logind_manager_on_signal_prepare_for_sleep), NULL);
-        logind_manager_take_sleep_delay_lock();
-    }
+    guint i;
 
-    GVariant *data;
-    gchar *name;
-    if (!user_data) {
-        data = g_variant_new("(u)", getpid());
-        name = "GetSessionByPID";
-    } else {
-        data = g_variant_new("(s)", user_data);
-        name = "GetSession";
-    }
+    for (i = 0; screen->idle_children && i < idle_stages->len; i++)
+        kill_child(&screen->idle_children[i]);
+}
 
-    g_dbus_proxy_call(logind_manager, name, data, G_DBUS_CALL_FLAGS_NONE,
-                      -1, NULL, logind_manager_call_get_session_cb, NULL);
+static gboolean
+has_notifier(Screen *screen)
+{
+    return screen->notifier.cmd || screen->backlight;
 }
 
+/* The built-in fade runs alongside the notifier command, if there is one */
 static void
-logind_manager_take_sleep_delay_lock(void)
+start_notifier(Screen *screen)
 {
-    if (sleep_lock_fd >= 0)
-        return;
+    if (screen->notifier.cmd)
+        start_child(&screen->notifier);
+    if (screen->backlight)
+        backlight_fade(screen->backlight, dim_duration, dim_curve);
+}
 
-    g_dbus_proxy_call_with_unix_fd_list(logind_manager, "Inhibit",
-                                        g_variant_new("(ssss)", "sleep", APP_NAME,
-                                                      "Lock screen first", "delay"),
-                                        G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL,
-                                        logind_manager_call_inhibit_cb, NULL);
+static void
+stop_notifier(Screen *screen)
+{
+    kill_child(&screen->notifier);
+    if (screen->backlight)
+        backlight_restore(screen->backlight);
 }
 
 static void
-logind_manager_call_inhibit_cb(GObject *source_object, GAsyncResult *res,
-                               gpointer user_data)
+start_child(Child *child)
 {
-    GVariant *result = NULL;
+    ChildEnv env = CHILD_ENV_PLAIN;
+    gint child_fd = -1;
+    gint ready_pipe[2] = {-1, -1};
     GError *error = NULL;
-    GUnixFDList *fd_list;
-    gint32 fd_index = 0;
-    
-    result = g_dbus_proxy_call_with_unix_fd_list_finish(logind_manager,
-                                                        &fd_list, res, &error);
-    if (!result) {
-        g_warning("Error taking sleep inhibitor lock: %s", error->message);
-        g_error_free(error);
-        return;
+
+    if (child_running(child))
+        goto out;
+
+    if (child->trigger_time)
+        stats_record_latency(child->trigger, STATS_STAGE_START, child->trigger_time);
+
+    if (child->kill_first)
+        kill_child(child->kill_first);
+
+    if (child->standby && child->cmd == child->standby->cmd
+        && activate_standby(child))
+        goto spawned;
+
+    if (preparing_for_sleep && sleep_lock_fd >= 0 && child->transfer_sleep_lock_fd) {
+        env = CHILD_ENV_SLEEP_LOCK;
+        child_fd = sleep_lock_fd;
+    } else if (preparing_for_sleep && sleep_lock_fd >= 0 && settings->ready_timeout > 0) {
+        if (g_unix_open_pipe(ready_pipe, FD_CLOEXEC, &error)) {
+            env = CHILD_ENV_READY;
+            child_fd = ready_pipe[1];
+            watch_locker_windows(child->screen, TRUE);
+        } else {
+            g_warning("Error creating readiness pipe: %s", error->message);
+            g_clear_error(&error);
+        }
     }
 
-    g_variant_get(result, "(h)", &fd_index);
-    sleep_lock_fd = g_unix_fd_list_get(fd_list, fd_index, &error);
-    if (sleep_lock_fd == -1) {
-        g_warning("Error getting file descriptor for sleep inhibitor lock: %s",
-                   error->message);
+    if (!spawn_async(child->path, child->cmd, child->screen->env[env], child_fd,
+                     &child->pid, &error)) {
+        g_warning("Error spawning %s: %s", child->name, error->message);
         g_error_free(error);
+        if (ready_pipe[0] >= 0) {
+            close(ready_pipe[0]);
+            watch_locker_windows(child->screen, FALSE);
+        }
+        goto out;
     }
-    g_variant_unref(result);
-    g_object_unref(fd_list);
+    watch_child(child, (GChildWatchFunc)child_watch_cb);
+    if (ready_pipe[0] >= 0)
+        child->screen->ready_fd = ready_pipe[0];
+
+spawned:
+    child->spawn_time = trace_now();
+    PROBE4(child_spawn, child->name, child->pid, child_fd,
+           child->trigger_time ? trace_now() - child->trigger_time : -1);
+    replay_action(child->screen, "start %s", child->name);
+    if (child->trigger_time)
+        stats_record_latency(child->trigger, STATS_STAGE_SPAWN, child->trigger_time);
+
+out:
+    if (ready_pipe[1] >= 0) close(ready_pipe[1]);
+    child->trigger_time = 0;
+}
+
+/* A trigger is timed from when its event was read, if known, so that its
+ * latencies include the wait for the main loop to get to it.
+ */
+static gint64
+lock_trigger_time(StatsTrigger trigger, gint64 arrival)
+{
+    if (!arrival)
+        return trace_now();
+    stats_record_latency(trigger, STATS_STAGE_DISPATCH, arrival);
+    return arrival;
 }
 
+/* There is only ever one locker per screen; its command is picked by whatever
+ * triggered it, when it is not running yet.
+ */
 static void
-logind_manager_on_signal_prepare_for_sleep(GDBusProxy *proxy,
-                                           gchar      *sender_name,
-                                           gchar      *signal_name,
-                                           GVariant   *parameters,
-                                           gpointer    user_data)
+start_locker(Screen *screen, StatsTrigger trigger, gint64 trigger_time)
 {
-    gboolean active;
+    Child *locker = &screen->locker;
 
-    if (g_strcmp0(signal_name, "PrepareForSleep"))
+    if (screen->lost)
         return;
 
-    g_variant_get(parameters, "(b)", &active);
-    if (active) {
-        preparing_for_sleep = TRUE;
+    if (!child_running(locker))
+        use_locker_for(locker, trigger);
+    screen->locker.trigger = trigger;
+    screen->locker.trigger_time = trigger_time;
+    screen->locker.respawn = TRUE;
+    if (screen->backlight)
+        backlight_restore(screen->backlight);
+    start_child(&screen->locker);
+}
 
-        start_child(&locker);
+/* The trigger's own locker if it has one, the default locker otherwise */
+static void
+use_locker_for(Child *locker, StatsTrigger trigger)
+{
+    const TriggerLocker *trigger_locker = &settings->trigger_lockers[trigger];
 
-        if (sleep_lock_fd >= 0) {
-            close(sleep_lock_fd);
-            sleep_lock_fd = -1;
-        }
-        preparing_for_sleep = FALSE;
-    } else
-        logind_manager_take_sleep_delay_lock();
+    if (trigger_locker->cmd) {
+        locker->cmd = trigger_locker->cmd;
+        locker->path = trigger_locker->path;
+        locker->transfer_sleep_lock_fd = trigger_locker->transfer_sleep_lock_fd;
+    } else {
+        locker->cmd = settings->locker_cmd;
+        locker->path = settings->locker_path;
+        locker->transfer_sleep_lock_fd = settings->transfer_sleep_lock;
+    }
 }
 
-static void
-logind_manager_call_get_session_cb(GObject *source_object, GAsyncResult *res,
-                                   gpointer user_data)
+/* How a trace refers to a child of a screen */
+static guint8
+child_id(Child *child)
 {
-    GVariant *result;
-    GError *error = NULL;
-    gchar *session_object_path = NULL;
+    Screen *screen = child->screen;
+
+    if (child == &screen->notifier)
+        return 0;
+    if (child == &screen->locker)
+        return 1;
+    if (child == &screen->standby)
+        return 2;
+    return 3 + (child - screen->idle_children);
+}
 
-    result = g_dbus_proxy_call_finish(logind_manager, res, &error);
-    if (!result) {
-        g_warning("Error getting session: %s", error->message);
-        g_error_free(error);
-        return;
+static Child *
+child_by_id(Screen *screen, guint8 id)
+{
+    switch (id) {
+    case 0:
+        return &screen->notifier;
+    case 1:
+        return &screen->locker;
+    case 2:
+        return &screen->standby;
+    default:
+        return idle_stages && id - 3 < idle_stages->len
+               ? &screen->idle_children[id - 3] : NULL;
     }
-    g_variant_get(result, "(o)", &session_object_path);
-    g_dbus_proxy_new_for_bus(G_BUS_TYPE_SYSTEM,
-                             G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
-                             LOGIND_SERVICE, session_object_path,
-                             LOGIND_SESSION_INTERFACE, NULL,
-                             logind_session_proxy_new_cb, NULL);
-    g_variant_unref(result);
-    g_free(session_object_path);
 }
 
+/* Children are watched through a pidfd on the main loop where the kernel
+ * supports it, and through GLib's SIGCHLD handling otherwise. Replayed
+ * children are not watched at all; their exits come from the trace.
+ */
 static void
-logind_session_proxy_new_cb(GObject *source_object, GAsyncResult *res,
-                            gpointer user_data)
+watch_child(Child *child, GChildWatchFunc func)
 {
-    GError *error = NULL;
+    child->exit_func = func;
+    g_hash_table_add(tracked_pids, GINT_TO_POINTER(child->pid));
+    child->pidfd = spawn_pidfd_open(child->pid);
+    if (child->pidfd >= 0) {
+        stats_source_added();
+        child->watch = g_unix_fd_add_full(G_PRIORITY_DEFAULT, child->pidfd,
+                                          G_IO_IN,
+                                          (GUnixFDSourceFunc)child_pidfd_cb,
+                                          child, stats_source_removed);
+    } else if (!opt_replay) {
+        stats_source_added();
+        child->watch = g_child_watch_add_full(G_PRIORITY_DEFAULT, child->pid,
+                                              func, child, stats_source_removed);
+    }
+}
+
+static gboolean
+child_pidfd_cb(gint fd, GIOCondition condition, Child *child)
+{
+    GPid pid = child->pid;
+    gint status;
 
-    logind_session = g_dbus_proxy_new_for_bus_finish(res, &error);
+    if (!reap(pid, &status))
+        return TRUE;
 
-    if (!logind_session) {
-        g_warning("Error connecting to session: %s", error->message);
-        g_error_free(error);
-        return;
-    }
-    g_signal_connect(logind_session, "g-signal",
-                     G_CALLBACK(logind_session_on_signal_lock), NULL);
+    child->watch = 0;
+    child->exit_func(pid, status, child);
+    return FALSE;
+}
+
+/* Returns whether the process is gone. One that cannot be waited for (e.g.,
+ * reaped by the kernel with SIGCHLD ignored) would keep its pidfd readable
+ * for good, so it counts as gone too, with a status that is taken to be 0.
+ */
+static gboolean
+reap(GPid pid, gint *status)
+{
+    pid_t result;
+
+    while ((result = waitpid(pid, status, WNOHANG)) < 0 && errno == EINTR);
+    if (result >= 0)
+        return result > 0;
+
+    g_warning("Error waiting for process %d: %s; taking it to have exited",
+              pid, g_strerror(errno));
+    *status = 0;
+    return TRUE;
 }
 
 static void
-logind_session_on_signal_lock(GDBusProxy *proxy,
-                              gchar      *sender_name,
-                              gchar      *signal_name,
-                              GVariant   *parameters,
-                              gpointer    user_data)
+child_exited(Child *child)
 {
-    if (!g_strcmp0(signal_name, "Lock"))
-        start_child(&locker);
-    else if (!g_strcmp0(signal_name, "Unlock"))
-        kill_child(&locker);
+    g_hash_table_remove(tracked_pids, GINT_TO_POINTER(child->pid));
+    if (child->pidfd >= 0) close(child->pidfd);
+    child->watch = 0;
+    child->pidfd = -1;
+    g_spawn_close_pid(child->pid);
+    child->pid = 0;
 }
 
+/* Killed on purpose, the child is not started again however it exits */
 static void
-logind_session_set_idle_hint(gboolean idle)
+kill_child(Child *child)
 {
-    if (logind_session)
-        g_dbus_proxy_call(logind_session, "SetIdleHint", g_variant_new("(b)", idle),
-                          G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+    child->respawn = FALSE;
+    if (child->respawn_timeout) {
+        trace_source_remove(child->respawn_timeout);
+        child->respawn_timeout = 0;
+    }
+    if (!child_running(child))
+        return;
+
+    signal_child(child, SIGTERM);
+    if (settings->kill_timeout > 0 && !child->kill_timeout)
+        child->kill_timeout = trace_timeout_add(settings->kill_timeout,
+                                                (GSourceFunc)kill_child_timeout_cb,
+                                                child);
 }
 
 static gboolean
-parse_options(int argc, char *argv[], GError **error)
+kill_child_timeout_cb(Child *child)
 {
-    GOptionContext *opt_context;
-    gboolean success;
+    stats_count_wakeup(STATS_WAKEUP_TIMER);
 
-    opt_context = g_option_context_new("- use external locker as X screen saver");
-    g_option_context_add_main_entries(opt_context, opt_entries, NULL);
-    success = g_option_context_parse(opt_context, &argc, &argv, error);
-    g_option_context_free(opt_context);
+    child->kill_timeout = 0;
+    g_message("%s still running %d ms after SIGTERM; killing it",
+              child->name, settings->kill_timeout);
+    signal_child(child, SIGKILL);
+    return FALSE;
+}
 
-    if (success && !locker.cmd) {
-        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
-                    "No %s specified", locker.name);
-        success = FALSE;
+/* Signals the child along with any descendants it left behind */
+static void
+signal_child(Child *child, gint signal)
+{
+    GSList *link;
+
+    if (child->pid) {
+        PROBE3(child_kill, child->name, child->pid, signal);
+        replay_action(child->screen, "send %s to %s", g_strsignal(signal),
+                      child->name);
+        if (!spawn_kill(child->pid, child->pidfd, signal))
+            g_warning("Error sending %s to %s: %s", g_strsignal(signal),
+                      child->name, g_strerror(errno));
+    }
+    for (link = child->adopted; link; link = link->next) {
+        Adopted *adopted = link->data;
+
+        PROBE3(child_kill, child->name, adopted->pid, signal);
+        spawn_kill(adopted->pid, adopted->pidfd, signal);
     }
-    return success;
 }
 
+/* A child counts as running until the last process of its tree exits, so
+ * that lockers that fork into the background are tracked as well
+ */
 static gboolean
-parse_notifier_cmd(const gchar *option_name, const gchar *value,
-                   gpointer data, GError **error)
+child_running(Child *child)
 {
-    GError *parse_error = NULL;
+    return child->pid || child->adopted;
+}
 
-    if (!g_shell_parse_argv(value, NULL, &notifier.cmd, &parse_error)) {
-        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
-                    "Error parsing argument for %s: %s",
-                    option_name, parse_error->message);
-        g_error_free(parse_error);
-        return FALSE;
+static void
+child_finished(Child *child)
+{
+    if (child->kill_timeout) {
+        trace_source_remove(child->kill_timeout);
+        child->kill_timeout = 0;
     }
-    return TRUE;
+    if (child->respawn && child->failed) {
+        respawn_child(child);
+    } else {
+        child->respawn = FALSE;
+        child->quick_exits = 0;
+    }
+    if (child->standby)
+        start_standby(child->standby);
 }
 
+/* Crashes, OOM kills and failures count; the signals that are meant to end a
+ * locker (e.g., with pkill) do not.
+ */
 static gboolean
-reset_screensaver(xcb_connection_t *connection)
+exit_abnormal(gint status)
 {
-    if (!locker.pid)
-        xcb_force_screen_saver(connection, XCB_SCREEN_SAVER_RESET);
-    return TRUE;
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status) != 0;
+    return WIFSIGNALED(status) && WTERMSIG(status) != SIGTERM
+           && WTERMSIG(status) != SIGINT && WTERMSIG(status) != SIGHUP;
 }
 
-static gboolean
-exit_service(GMainLoop *loop)
+/* A locker that dies while the session should stay locked is started again
+ * right away, unless it keeps dying quickly: then each restart waits twice as
+ * long as the one before, up to RESPAWN_MAX_DELAY.
+ */
+static void
+respawn_child(Child *child)
 {
-    kill_child(&notifier);
-    kill_child(&locker);
-    g_main_loop_quit(loop);
-    return TRUE;
+    guint delay = 0;
+
+    if (trace_now() - child->spawn_time < RESPAWN_MIN_LIFETIME)
+        child->quick_exits++;
+    else
+        child->quick_exits = 0;
+    if (child->quick_exits > 1)
+        delay = MIN(RESPAWN_FIRST_DELAY << MIN(child->quick_exits - 2, 8),
+                    RESPAWN_MAX_DELAY);
+
+    stats_count_respawn();
+    if (!delay) {
+        g_message("%s exited abnormally; starting it again", child->name);
+        start_child(child);
+        return;
+    }
+    g_message("%s keeps exiting abnormally; starting it again in %u ms",
+              child->name, delay);
+    child->respawn_timeout = trace_timeout_add_full(PRIORITY_LOCK, delay,
+                                                    (GSourceFunc)respawn_timeout_cb,
+                                                    child);
 }
 
-static void
-log_handler(const gchar *log_domain, GLogLevelFlags log_level,
-            const gchar *message, gpointer user_data)
+static gboolean
+respawn_timeout_cb(Child *child)
 {
-    if (opt_verbose || log_level & G_LOG_FLAG_FATAL
-        || !(opt_quiet || log_level & G_LOG_LEVEL_MESSAGE))
-        g_log_default_handler(log_domain, log_level, message, user_data);
+    stats_count_wakeup(STATS_WAKEUP_TIMER);
+
+    child->respawn_timeout = 0;
+    start_child(child);
+    return FALSE;
 }
 
-int
-main(int argc, char *argv[])
+/* xss-lock is a child subreaper, so processes whose parent exits are
+ * reparented to it. Any that are not tracked yet are taken to be left behind
+ * by the child that just exited. Which process they came from is not known;
+ * with several screens, orphans whose $DISPLAY names another screen are left
+ * for the scan on that screen's own child exiting, but within a screen they
+ * are credited to whichever child happened to exit.
+ */
+static void
+adopt_orphans(Child *child)
 {
-    GMainLoop *loop;
-    GError *error = NULL;
-    xcb_connection_t *connection = NULL;
-    int default_screen_number;
-    xcb_screen_t *default_screen;
-    xcb_atom_t atom;
+    GDir *tasks;
+    const gchar *task;
 
-    setlocale(LC_ALL, "");
-    
-    if (!parse_options(argc, argv, &error) || opt_print_version) {
-        if (opt_print_version) {
-            g_print(VERSION "\n");
-            g_clear_error(&error);
+    if (!subreaper || !(tasks = g_dir_open("/proc/self/task", 0, NULL)))
+        return;
+    while ((task = g_dir_read_name(tasks))) {
+        gchar *path = g_build_filename("/proc/self/task", task, "children", NULL);
+        gchar *children = NULL, **pids, **pid;
+
+        if (!g_file_get_contents(path, &children, NULL, NULL)) {
+            g_free(path);
+            continue;
         }
-        goto init_error;
+        pids = g_strsplit(g_strstrip(children), " ", -1);
+        for (pid = pids; *pid; pid++) {
+            Adopted *adopted;
+            GPid orphan = atoi(*pid);
+
+            if (orphan <= 0
+                || g_hash_table_contains(tracked_pids, GINT_TO_POINTER(orphan))
+                || !orphan_of_screen(orphan, child->screen))
+                continue;
+
+            g_debug("Adopting process %d left behind by %s", orphan, child->name);
+            adopted = g_new(Adopted, 1);
+            adopted->pid = orphan;
+            adopted->child = child;
+            adopted->pidfd = spawn_pidfd_open(orphan);
+            stats_source_added();
+            if (adopted->pidfd >= 0)
+                adopted->watch = g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+                                                    adopted->pidfd, G_IO_IN,
+                                                    (GUnixFDSourceFunc)adopted_pidfd_cb,
+                                                    adopted, stats_source_removed);
+            else
+                adopted->watch = g_child_watch_add_full(G_PRIORITY_DEFAULT, orphan,
+                                                        (GChildWatchFunc)adopted_watch_cb,
+                                                        adopted, stats_source_removed);
+            g_hash_table_add(tracked_pids, GINT_TO_POINTER(orphan));
+            child->adopted = g_slist_prepend(child->adopted, adopted);
+        }
+        g_strfreev(pids);
+        g_free(children);
+        g_free(path);
     }
-    g_log_set_default_handler(log_handler, NULL);
-    g_log_set_fatal_mask(NULL, G_LOG_LEVEL_CRITICAL);
+    g_dir_close(tasks);
+}
 
-    connection = xcb_connect(NULL, &default_screen_number);
-    if (xcb_connection_has_error(connection)) {
-        g_set_error(&error, XCB_ERROR, 0, "Connecting to X server failed");
-        goto init_error;
+/* Processes that cleared their environment, or whose environment cannot be
+ * read, belong to any screen.
+ */
+static gboolean
+orphan_of_screen(GPid orphan, Screen *screen)
+{
+    gchar *path, *contents, *variable, *end;
+    gsize length;
+    const gchar *display;
+    gboolean found = TRUE;
+
+    if (!screens->next)
+        return TRUE;
+
+    path = g_strdup_printf("/proc/%d/environ", orphan);
+    if (!g_file_get_contents(path, &contents, &length, NULL)) {
+        g_free(path);
+        return TRUE;
+    }
+    display = screen->display ? screen->display : g_getenv("DISPLAY");
+    end = contents + length;
+    for (variable = contents; variable < end; variable += strlen(variable) + 1) {
+        if (g_str_has_prefix(variable, "DISPLAY=")) {
+            found = !g_strcmp0(variable + strlen("DISPLAY="), display);
+            break;
+        }
     }
+    g_free(contents);
+    g_free(path);
+    return found;
+}
 
-#if !GLIB_CHECK_VERSION(2, 36, 0)
-    g_type_init();
-#endif
- 
-    g_dbus_proxy_new_for_bus(G_BUS_TYPE_SYSTEM,
-                             G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
-                             LOGIND_SERVICE, LOGIND_PATH, LOGIND_MANAGER_INTERFACE,
-                             NULL, logind_manager_proxy_new_cb, opt_session);
+static gboolean
+adopted_pidfd_cb(gint fd, GIOCondition condition, Adopted *adopted)
+{
+    gint status;
+
+    if (!reap(adopted->pid, &status))
+        return TRUE;
+
+    adopted_watch_cb(adopted->pid, status, adopted);
+    return FALSE;
+}
+
+static void
+adopted_watch_cb(GPid pid, gint status, Adopted *adopted)
+{
+    Child *child = adopted->child;
+
+    stats_count_wakeup(STATS_WAKEUP_CHILD);
+    PROBE3(child_exit, child->name, pid, status);
+
+    adopt_orphans(child);
+    g_hash_table_remove(tracked_pids, GINT_TO_POINTER(pid));
+    child->adopted = g_slist_remove(child->adopted, adopted);
+    child->failed = exit_abnormal(status);
+    if (adopted->pidfd >= 0) close(adopted->pidfd);
+    g_spawn_close_pid(pid);
+    g_free(adopted);
+
+    if (!child_running(child)) {
+        trace_record(TRACE_INPUT_CHILD_FINISHED, child->screen->index,
+                     child_id(child), 0, 0, status);
+        child_finished(child);
+    }
+}
+
+static void
+child_watch_cb(GPid pid, gint status, Child *child)
+{
+#if GLIB_CHECK_VERSION(2, 34, 0)
+    GError *error = NULL;
+#endif
+
+    stats_count_wakeup(STATS_WAKEUP_CHILD);
+    PROBE3(child_exit, child->name, pid, status);
+#if GLIB_CHECK_VERSION(2, 34, 0)
+    if (!g_spawn_check_exit_status(status, &error)) {
+        g_message("%s exited abnormally: %s", child->name, error->message);
+        g_error_free(error);
+    }
+#endif
+    adopt_orphans(child);
+    trace_record(TRACE_INPUT_CHILD_EXIT, child->screen->index, child_id(child),
+                 child->adopted != NULL, 0, status);
+    child->failed = exit_abnormal(status);
+    child_exited(child);
+    if (!child_running(child))
+        child_finished(child);
+}
+
+/* A standby locker is spawned ahead of time with one end of a socket in
+ * $XSS_STANDBY_FD. It initializes and waits for the STANDBY_LOCK byte before
+ * locking the screen, which may come with the sleep delay lock attached.
+ */
+static void
+start_standby(Child *standby)
+{
+    Screen *screen = standby->screen;
+    gint fds[2];
+    GError *error = NULL;
+
+    if (standby->pid || screen->lost)
+        return;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)) {
+        g_warning("Error creating socket for %s: %s", standby->name,
+                  g_strerror(errno));
+        return;
+    }
+
+    if (!spawn_async(standby->path, standby->cmd, screen->env[CHILD_ENV_STANDBY],
+                     fds[1], &standby->pid, &error)) {
+        g_warning("Error spawning %s: %s", standby->name, error->message);
+        g_error_free(error);
+        close(fds[0]);
+    } else {
+        PROBE4(child_spawn, standby->name, standby->pid, fds[1], (gint64)-1);
+        watch_child(standby, (GChildWatchFunc)standby_watch_cb);
+        screen->standby_fd = fds[0];
+        screen->standby_start_time = trace_now();
+    }
+    close(fds[1]);
+}
+
+static gboolean
+activate_standby(Child *child)
+{
+    Child *standby = child->standby;
+    Screen *screen = child->screen;
+    gchar command = STANDBY_LOCK;
+    struct iovec iov = {&command, 1};
+    struct msghdr msg = {0};
+    union {
+        struct cmsghdr header;
+        gchar buf[CMSG_SPACE(sizeof(gint))];
+    } control;
+
+    if (!standby->pid)
+        return FALSE;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (preparing_for_sleep && child->transfer_sleep_lock_fd && sleep_lock_fd >= 0) {
+        struct cmsghdr *cmsg;
+
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(gint));
+        memcpy(CMSG_DATA(cmsg), &sleep_lock_fd, sizeof(gint));
+    }
+
+    if (sendmsg(screen->standby_fd, &msg, MSG_NOSIGNAL) != 1) {
+        g_warning("Error activating %s: %s", standby->name, g_strerror(errno));
+        kill_child(standby);
+        return FALSE;
+    }
+    if (preparing_for_sleep && !child->transfer_sleep_lock_fd
+        && sleep_lock_fd >= 0 && settings->ready_timeout > 0)
+        screen->ready_fd = screen->standby_fd;
+    else
+        close(screen->standby_fd);
+    screen->standby_fd = -1;
+
+    /* From here on, the process is the locker */
+    g_source_remove(standby->watch);
+    if (standby->pidfd >= 0) close(standby->pidfd);
+    g_hash_table_remove(tracked_pids, GINT_TO_POINTER(standby->pid));
+    standby->watch = 0;
+    standby->pidfd = -1;
+    child->pid = standby->pid;
+    standby->pid = 0;
+    watch_child(child, (GChildWatchFunc)child_watch_cb);
+    return TRUE;
+}
+
+static void
+standby_watch_cb(GPid pid, gint status, Child *standby)
+{
+    Screen *screen = standby->screen;
+
+    stats_count_wakeup(STATS_WAKEUP_CHILD);
+    PROBE3(child_exit, standby->name, pid, status);
+
+    g_message("%s exited before activation", standby->name);
+    adopt_orphans(standby);
+    trace_record(TRACE_INPUT_CHILD_EXIT, screen->index, child_id(standby),
+                 standby->adopted != NULL, 0, status);
+    child_exited(standby);
+    /* Whatever it left behind is of no use without it */
+    if (standby->adopted)
+        kill_child(standby);
+    close(screen->standby_fd);
+    screen->standby_fd = -1;
+
+    if (trace_now() - screen->standby_start_time < STANDBY_MIN_LIFETIME) {
+        g_warning("%s keeps exiting; falling back to starting %s on demand",
+                  standby->name, screen->locker.name);
+        screen->locker.standby = NULL;
+    }
+    if (screen->locker.standby)
+        start_standby(standby);
+}
+
+/* Hold on to the sleep delay lock until every locker started for it writes to
+ * (or closes) its readiness channel or is seen to cover the screen, or until
+ * the budget runs out.
+ */
+static void
+wait_for_lockers(void)
+{
+    GSList *link;
+
+    if (!lockers_pending()) {
+        release_sleep_lock();
+        return;
+    }
+
+    for (link = screens; link; link = link->next) {
+        Screen *screen = link->data;
+
+        if (screen->ready_fd >= 0 && !screen->ready_watch) {
+            stats_source_added();
+            screen->ready_watch =
+                g_unix_fd_add_full(G_PRIORITY_DEFAULT, screen->ready_fd,
+                                   G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                   (GUnixFDSourceFunc)locker_ready_cb, screen,
+                                   stats_source_removed);
+        }
+    }
+    if (!ready_timeout)
+        ready_timeout = trace_timeout_add(settings->ready_timeout, locker_ready_timeout_cb, NULL);
+}
+
+static gboolean
+lockers_pending(void)
+{
+    GSList *link;
+
+    for (link = screens; link; link = link->next)
+        if (((Screen *)link->data)->ready_fd >= 0)
+            return TRUE;
+    return FALSE;
+}
+
+static void
+stop_waiting_for_locker(Screen *screen)
+{
+    if (screen->ready_watch) {
+        g_source_remove(screen->ready_watch);
+        screen->ready_watch = 0;
+    }
+    if (screen->ready_fd >= 0) {
+        close(screen->ready_fd);
+        screen->ready_fd = -1;
+    }
+    watch_locker_windows(screen, FALSE);
+}
+
+static gboolean
+locker_ready_cb(gint fd, GIOCondition condition, Screen *screen)
+{
+    gchar byte;
+
+    stats_count_wakeup(STATS_WAKEUP_CHILD);
+
+    trace_record(TRACE_INPUT_LOCKER_READY, screen->index, 0, 0, 0, 0);
+    if (condition & G_IO_IN && read(fd, &byte, 1) == 1)
+        g_debug("%s is ready", screen->locker.name);
+    else
+        g_debug("%s closed its readiness channel", screen->locker.name);
+
+    screen->ready_watch = 0;
+    stop_waiting_for_locker(screen);
+    wait_for_lockers();
+    return FALSE;
+}
+
+static gboolean
+locker_ready_timeout_cb(gpointer user_data)
+{
+    stats_count_wakeup(STATS_WAKEUP_TIMER);
+
+    g_message("Locker not ready after %d ms; releasing sleep delay lock",
+              settings->ready_timeout);
+
+    ready_timeout = 0;
+    release_sleep_lock();
+    return FALSE;
+}
+
+/* Fallback for lockers that do not use the readiness channel: the locker is
+ * taken to be up once an override-redirect window created after it started is
+ * mapped over the whole screen. Only the root window's children are watched,
+ * and only while waiting; nothing is grabbed, so the locker's own grabs cannot
+ * fail because of it.
+ */
+static void
+watch_locker_windows(Screen *screen, gboolean watch)
+{
+    uint32_t mask = screen->fullscreen ? XCB_EVENT_MASK_PROPERTY_CHANGE
+                                       : XCB_EVENT_MASK_NO_EVENT;
+
+    if (watch == screen->watching_windows)
+        return;
+    screen->watching_windows = watch;
+    if (watch) {
+        mask |= XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+    } else {
+        g_slist_free(screen->new_windows);
+        screen->new_windows = NULL;
+    }
+    /* Flushed before the locker is spawned, so its window cannot be missed */
+    xcb_change_window_attributes(screen->connection, screen->xcb_screen->root,
+                                 XCB_CW_EVENT_MASK, &mask);
+    xcb_flush(screen->connection);
+}
+
+static void
+locker_window_event(Screen *screen, xcb_generic_event_t *event)
+{
+    switch (XCB_EVENT_RESPONSE_TYPE(event)) {
+    case XCB_CREATE_NOTIFY: {
+        xcb_create_notify_event_t *create = (xcb_create_notify_event_t *)event;
+
+        if (create->override_redirect)
+            screen->new_windows = g_slist_prepend(screen->new_windows,
+                                                  GUINT_TO_POINTER(create->window));
+        break;
+    }
+    case XCB_DESTROY_NOTIFY:
+        screen->new_windows =
+            g_slist_remove(screen->new_windows,
+                           GUINT_TO_POINTER(((xcb_destroy_notify_event_t *)event)->window));
+        break;
+    case XCB_MAP_NOTIFY: {
+        xcb_window_t window = ((xcb_map_notify_event_t *)event)->window;
+
+        if (screen->ready_fd < 0
+            || !g_slist_find(screen->new_windows, GUINT_TO_POINTER(window))
+            || !locker_window_covers(screen, window))
+            break;
+        g_debug("%s covers the screen; assuming it is ready", screen->locker.name);
+        trace_record(TRACE_INPUT_LOCKER_READY, screen->index, 0, 0, 0, 0);
+        stop_waiting_for_locker(screen);
+        wait_for_lockers();
+        break;
+    }
+    }
+}
+
+/* A window that names its process (_NET_WM_PID) must belong to the locker;
+ * i3lock and slock do not, and only their size and timing tell.
+ */
+static gboolean
+locker_window_covers(Screen *screen, xcb_window_t window)
+{
+    xcb_connection_t *connection = screen->connection;
+    xcb_get_geometry_cookie_t geometry_cookie;
+    xcb_get_geometry_reply_t *geometry;
+    xcb_get_property_cookie_t pid_cookie;
+    xcb_get_property_reply_t *pid_reply;
+    gboolean covers;
+
+    geometry_cookie = xcb_get_geometry(connection, window);
+    pid_cookie = xcb_get_property(connection, FALSE, window, screen->wm_pid_atom,
+                                  XCB_ATOM_CARDINAL, 0, 1);
+    geometry = xcb_get_geometry_reply(connection, geometry_cookie, NULL);
+    pid_reply = xcb_get_property_reply(connection, pid_cookie, NULL);
+
+    covers = geometry && geometry->x <= 0 && geometry->y <= 0
+             && geometry->x + geometry->width >= screen->xcb_screen->width_in_pixels
+             && geometry->y + geometry->height >= screen->xcb_screen->height_in_pixels;
+    if (covers && pid_reply && pid_reply->format == 32
+        && xcb_get_property_value_length(pid_reply) == 4)
+        covers = child_owns_pid(&screen->locker,
+                                *(uint32_t *)xcb_get_property_value(pid_reply));
+
+    free(geometry);
+    free(pid_reply);
+    return covers;
+}
+
+static gboolean
+child_owns_pid(Child *child, GPid pid)
+{
+    GSList *link;
+
+    if (pid == child->pid)
+        return TRUE;
+    for (link = child->adopted; link; link = link->next)
+        if (((Adopted *)link->data)->pid == pid)
+            return TRUE;
+    return FALSE;
+}
+
+static void
+release_sleep_lock(void)
+{
+    GSList *link;
+
+    for (link = screens; link; link = link->next)
+        stop_waiting_for_locker(link->data);
+    if (ready_timeout) trace_source_remove(ready_timeout);
+    ready_timeout = 0;
+
+    /* Only a release in answer to PrepareForSleep is timed, not one because
+     * sleep is to be ignored from now on.
+     */
+    if (sleep_lock_fd >= 0) {
+        PROBE2(sleep_lock_release, sleep_lock_fd,
+               sleep_trigger_time ? trace_now() - sleep_trigger_time : -1);
+        replay_action(NULL, "release sleep delay lock");
+        close(sleep_lock_fd);
+        sleep_lock_fd = -1;
+        if (sleep_trigger_time)
+            stats_record_latency(STATS_TRIGGER_SLEEP,
+                                 STATS_STAGE_SLEEP_LOCK_RELEASE,
+                                 sleep_trigger_time);
+        sleep_trigger_time = 0;
+    }
+    set_sleep_nice(FALSE);
+}
+
+/* Linux keeps a nice value per thread, which includes GDBus's worker */
+static void
+set_sleep_nice(gboolean sleeping)
+{
+    gint nice = sleeping ? opt_sleep_nice : base_nice;
+    const gchar *name;
+    GDir *tasks;
+
+    if (opt_sleep_nice == G_MAXINT || !(tasks = g_dir_open("/proc/self/task", 0, NULL)))
+        return;
+    while ((name = g_dir_read_name(tasks)))
+        if (setpriority(PRIO_PROCESS, atoi(name), nice) < 0 && sleeping)
+            g_debug("Cannot change nice value of thread %s to %d: %s",
+                    name, nice, g_strerror(errno));
+    g_dir_close(tasks);
+}
+
+/* Once connected, the sleep inhibitor and the session lookups are all
+ * requested at once rather than one after the other; readiness is reported
+ * when every one of them has completed. Signals are subscribed to by member
+ * name, so the bus only delivers the ones that are handled.
+ */
+static void
+system_bus_get_cb(Bus *bus, const GError *error, gpointer user_data)
+{
+    stats_count_wakeup(STATS_WAKEUP_DBUS);
+
+    if (!bus) {
+        g_warning("Error connecting to system bus: %s", error->message);
+        startup_step_done();
+        return;
+    }
+    system_bus = bus;
+
+    logind_manager_watch_sleep(!settings->ignore_sleep, TRUE);
+    g_slist_foreach(screens, (GFunc)logind_manager_get_session, NULL);
+    startup_step_done();
+}
+
+static void
+startup_step_done(void)
+{
+    if (--startup_pending)
+        return;
+
+    stats_record_startup(STATS_STARTUP_READY, start_time);
+    g_debug("Ready after %" G_GINT64_FORMAT " ms",
+            (trace_now() - start_time) / 1000);
+    notify_ready();
+}
+
+/* The sd_notify(3) protocol: a datagram to the socket in $NOTIFY_SOCKET,
+ * where a leading '@' denotes the abstract namespace.
+ */
+static void
+notify_ready(void)
+{
+    const gchar *path = notify_socket;
+    struct sockaddr_un address = {AF_UNIX};
+    socklen_t length;
+    int sock;
+
+    if (!path || (path[0] != '/' && path[0] != '@')
+        || strlen(path) >= sizeof(address.sun_path))
+        return;
+
+    strcpy(address.sun_path, path);
+    length = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+    if (path[0] == '@')
+        address.sun_path[0] = '\0';
+
+    sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || sendto(sock, "READY=1", strlen("READY=1"), MSG_NOSIGNAL,
+                           (struct sockaddr *)&address, length) < 0)
+        g_warning("Error notifying service manager: %s", g_strerror(errno));
+    if (sock >= 0)
+        close(sock);
+}
+
+/* Also called when reloading the settings switches --ignore-sleep */
+static void
+logind_manager_watch_sleep(gboolean watch, gboolean startup)
+{
+    if (watch && !prepare_for_sleep_subscription) {
+        prepare_for_sleep_subscription =
+            bus_subscribe(system_bus, LOGIND_SERVICE, LOGIND_PATH,
+                          LOGIND_MANAGER_INTERFACE, "PrepareForSleep",
+                          logind_manager_on_signal_prepare_for_sleep, NULL);
+        if (startup)
+            startup_pending++;
+        logind_manager_take_sleep_delay_lock(startup);
+    } else if (!watch && prepare_for_sleep_subscription) {
+        bus_unsubscribe(system_bus, prepare_for_sleep_subscription);
+        prepare_for_sleep_subscription = 0;
+        release_sleep_lock();
+    }
+}
+
+static void
+logind_manager_take_sleep_delay_lock(gboolean startup)
+{
+    if (sleep_lock_fd >= 0)
+        return;
+
+    if (opt_replay) {
+        sleep_lock_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        return;
+    }
+
+    bus_call(system_bus, LOGIND_SERVICE, LOGIND_PATH, LOGIND_MANAGER_INTERFACE,
+             "Inhibit", g_variant_new("(ssss)", "sleep", APP_NAME,
+                                      "Lock screen first", "delay"),
+             G_VARIANT_TYPE("(h)"), logind_manager_call_inhibit_cb,
+             GINT_TO_POINTER(startup));
+}
+
+static void
+logind_manager_call_inhibit_cb(Bus *bus, GVariant *reply, gint fd,
+                               const GError *error, gpointer user_data)
+{
+    stats_count_wakeup(STATS_WAKEUP_DBUS);
+
+    if (GPOINTER_TO_INT(user_data))
+        startup_step_done();
+    if (!reply) {
+        g_warning("Error taking sleep inhibitor lock: %s", error->message);
+        return;
+    }
+
+    if (fd == -1) {
+        g_warning("No file descriptor for sleep inhibitor lock received");
+    } else if (!prepare_for_sleep_subscription || sleep_lock_fd >= 0) {
+        /* A reload switched sleep handling off and on again meanwhile */
+        close(fd);
+    } else {
+        sleep_lock_fd = fd;
+    }
+}
+
+static void
+logind_manager_on_signal_prepare_for_sleep(Bus *bus, const gchar *member,
+                                           GVariant *parameters,
+                                           gpointer user_data)
+{
+    gint64 now;
+    gboolean active;
+    GSList *link;
+
+    stats_count_wakeup(STATS_WAKEUP_DBUS);
+
+    g_variant_get(parameters, "(b)", &active);
+    PROBE2(sleep_prepare, active, sleep_lock_fd);
+    trace_record(TRACE_INPUT_SLEEP, 0, active, 0, 0, 0);
+    if (active) {
+        now = lock_trigger_time(STATS_TRIGGER_SLEEP,
+                                bus ? bus_signal_arrival_time(bus) : 0);
+        if (!ready_timeout)
+            sleep_trigger_time = now;
+        if (sleep_lock_fd >= 0)
+            set_sleep_nice(TRUE);
+        preparing_for_sleep = TRUE;
+
+        for (link = screens; link; link = link->next)
+            start_locker(link->data, STATS_TRIGGER_SLEEP, now);
+
+        preparing_for_sleep = FALSE;
+        wait_for_lockers();
+    } else {
+        sleep_trigger_time = 0;
+        release_sleep_lock();
+        logind_manager_take_sleep_delay_lock(FALSE);
+    }
+}
+
+/* Without --attach, the session defaults to the one xss-lock runs in */
+static void
+logind_manager_get_session(Screen *screen)
+{
+    GVariant *data;
+    gchar *name;
+
+    if (screen->session_id) {
+        data = g_variant_new("(s)", screen->session_id);
+        name = "GetSession";
+    } else if (!opt_attach) {
+        data = g_variant_new("(u)", getpid());
+        name = "GetSessionByPID";
+    } else
+        return;
+
+    startup_pending++;
+    bus_call(system_bus, LOGIND_SERVICE, LOGIND_PATH, LOGIND_MANAGER_INTERFACE,
+             name, data, G_VARIANT_TYPE("(o)"),
+             logind_manager_call_get_session_cb, screen);
+}
+
+static void
+logind_manager_call_get_session_cb(Bus *bus, GVariant *reply, gint fd,
+                                   const GError *error, gpointer user_data)
+{
+    Screen *screen = user_data;
+
+    stats_count_wakeup(STATS_WAKEUP_DBUS);
+
+    if (!reply) {
+        g_warning("Error getting session: %s", error->message);
+        startup_step_done();
+        return;
+    }
+    g_variant_get(reply, "(o)", &screen->session_path);
+
+    screen->lock_subscription =
+        bus_subscribe(system_bus, LOGIND_SERVICE, screen->session_path,
+                      LOGIND_SESSION_INTERFACE, "Lock",
+                      logind_session_on_signal_lock, screen);
+    screen->unlock_subscription =
+        bus_subscribe(system_bus, LOGIND_SERVICE, screen->session_path,
+                      LOGIND_SESSION_INTERFACE, "Unlock",
+                      logind_session_on_signal_lock, screen);
+    logind_session_set_idle_hint(screen, screen->idle_hint_wanted);
+    startup_step_done();
+}
+
+static void
+logind_session_on_signal_lock(Bus *bus, const gchar *member,
+                              GVariant *parameters, gpointer user_data)
+{
+    Screen *screen = user_data;
+
+    stats_count_wakeup(STATS_WAKEUP_DBUS);
+
+    trace_record(TRACE_INPUT_SESSION_LOCK, screen->index,
+                 !g_strcmp0(member, "Lock"), 0, 0, 0);
+    if (!g_strcmp0(member, "Lock"))
+        start_locker(screen, STATS_TRIGGER_SESSION_LOCK,
+                     lock_trigger_time(STATS_TRIGGER_SESSION_LOCK,
+                                       bus ? bus_signal_arrival_time(bus) : 0));
+    else if (!g_strcmp0(member, "Unlock"))
+        kill_child(&screen->locker);
+}
+
+/* The idle hint is only sent to logind when it differs from what was last
+ * sent, and only once it has held for --idle-hint-delay; a flip back within
+ * that window sends nothing at all. A call that has become stale before
+ * completing is cancelled.
+ */
+static void
+logind_session_set_idle_hint(Screen *screen, gboolean idle)
+{
+    gboolean current = screen->idle_hint_call ? screen->idle_hint_sent
+                                              : screen->idle_hint;
+
+    screen->idle_hint_wanted = idle;
+    if (!screen->session_path || screen->lost)
+        return;
+
+    if (screen->idle_hint_delay) {
+        trace_source_remove(screen->idle_hint_delay);
+        screen->idle_hint_delay = 0;
+    }
+    if (idle == current)
+        return;
+
+    if (settings->idle_hint_delay > 0)
+        screen->idle_hint_delay =
+            trace_timeout_add_full(PRIORITY_HOUSEKEEPING, settings->idle_hint_delay,
+                                   (GSourceFunc)logind_session_idle_hint_delay_cb,
+                                   screen);
+    else
+        logind_session_send_idle_hint(screen);
+}
+
+static gboolean
+logind_session_idle_hint_delay_cb(Screen *screen)
+{
+    stats_count_wakeup(STATS_WAKEUP_TIMER);
+
+    screen->idle_hint_delay = 0;
+    logind_session_send_idle_hint(screen);
+    return FALSE;
+}
+
+static void
+logind_session_send_idle_hint(Screen *screen)
+{
+    screen->idle_hint_sent = screen->idle_hint_wanted;
+
+    PROBE2(idle_hint, screen->session_id ? screen->session_id : "",
+           screen->idle_hint_sent);
+    if (opt_replay) {
+        replay_action(screen, "set idle hint %s",
+                      screen->idle_hint_sent ? "true" : "false");
+        screen->idle_hint = screen->idle_hint_sent;
+        return;
+    }
+
+    /* Superseded; no reply comes for it anymore */
+    if (screen->idle_hint_call)
+        bus_cancel(system_bus, screen->idle_hint_call);
+    screen->idle_hint_call =
+        bus_call(system_bus, LOGIND_SERVICE, screen->session_path,
+                 LOGIND_SESSION_INTERFACE, "SetIdleHint",
+                 g_variant_new("(b)", screen->idle_hint_sent), NULL,
+                 logind_session_call_set_idle_hint_cb, screen);
+}
+
+static void
+logind_session_call_set_idle_hint_cb(Bus *bus, GVariant *reply, gint fd,
+                                     const GError *error, gpointer user_data)
+{
+    Screen *screen = user_data;
+
+    stats_count_wakeup(STATS_WAKEUP_DBUS);
+
+    screen->idle_hint_call = 0;
+    if (!reply) {
+        g_warning("Error setting idle hint: %s", error->message);
+        return;
+    }
+    screen->idle_hint = screen->idle_hint_sent;
+}
+
+static void
+logind_session_cancel_idle_hint(Screen *screen)
+{
+    if (screen->idle_hint_delay) {
+        trace_source_remove(screen->idle_hint_delay);
+        screen->idle_hint_delay = 0;
+    }
+    if (screen->idle_hint_call) {
+        bus_cancel(system_bus, screen->idle_hint_call);
+        screen->idle_hint_call = 0;
+    }
+}
+
+/* The inhibit service applies to every screen, a fullscreen window only to
+ * the screen it is on.
+ */
+static gboolean
+screen_inhibited(Screen *screen)
+{
+    if (opt_replay)
+        return screen->saver_suspended;
+    return inhibit_service_active()
+           || (screen->fullscreen && fullscreen_active(screen->fullscreen));
+}
+
+/* While inhibited, the screen saver (and DPMS) timer is suspended if the server
+ * supports it; activation that gets through anyway is undone unless forced.
+ * The server counts suspend requests, so only changes are passed on.
+ */
+static void
+update_inhibit(Screen *screen)
+{
+    gboolean inhibited = screen_inhibited(screen);
+
+    if (screen->lost || inhibited == screen->saver_suspended)
+        return;
+
+    g_debug("Screen saver %s", inhibited ? "inhibited" : "no longer inhibited");
+    trace_record(TRACE_INPUT_INHIBIT, screen->index, inhibited, 0, 0, 0);
+    screen->saver_suspended = inhibited;
+    if (screen->suspendable)
+        xcb_screensaver_suspend(screen->connection, inhibited);
+    if (inhibited && !child_running(&screen->locker))
+        xcb_force_screen_saver(screen->connection, XCB_SCREEN_SAVER_RESET);
+    xcb_flush(screen->connection);
+}
+
+static void
+inhibit_changed_cb(gboolean inhibited, gpointer user_data)
+{
+    g_slist_foreach(screens, (GFunc)update_inhibit, NULL);
+}
+
+static gboolean
+parse_options(int argc, char *argv[], GError **error)
+{
+    GOptionContext *opt_context;
+    gboolean success;
+    guint i;
+
+    opt_context = g_option_context_new("- use external locker as X screen saver");
+    g_option_context_add_main_entries(opt_context, opt_entries, NULL);
+    success = g_option_context_parse(opt_context, &argc, &argv, error);
+    g_option_context_free(opt_context);
+
+    if (success)
+        success = (settings = settings_new(&cmdline_settings, opt_config, error)) != NULL;
+    if (success && idle_stages)
+        g_array_sort(idle_stages, compare_idle_stages);
+    if (success && opt_record && opt_replay) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    "Cannot record while replaying");
+        success = FALSE;
+    }
+    if (success && opt_sleep_nice != G_MAXINT
+        && (opt_sleep_nice < -20 || opt_sleep_nice > 19)) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    "Nice value %d out of range", opt_sleep_nice);
+        success = FALSE;
+    }
+
+    /* Search $PATH once, instead of on every spawn */
+    for (i = 0; success && idle_stages && i < idle_stages->len; i++) {
+        IdleStage *stage = &g_array_index(idle_stages, IdleStage, i);
+
+        if (stage->cmd)
+            success = (stage->path = spawn_resolve(stage->cmd[0], error)) != NULL;
+    }
+    return success;
+}
+
+static gboolean
+parse_notifier_cmd(const gchar *option_name, const gchar *value,
+                   gpointer data, GError **error)
+{
+    return settings_parse_cmd(option_name, value, &cmdline_settings.notifier_cmd,
+                              error);
+}
+
+static gboolean
+parse_dim(const gchar *option_name, const gchar *value,
+          gpointer data, GError **error)
+{
+    gchar *end;
+    guint64 milliseconds;
+
+    milliseconds = g_ascii_strtoull(value, &end, 10);
+    if (end == value || (*end && *end != ':') || milliseconds > G_MAXINT) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    "Invalid duration for %s: %s", option_name, value);
+        return FALSE;
+    }
+    if (*end && !backlight_curve_from_string(end + 1, &dim_curve)) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    "Invalid curve for %s: %s", option_name, end + 1);
+        return FALSE;
+    }
+    dim_duration = milliseconds;
+    return TRUE;
+}
+
+static gboolean
+parse_inhibit_fullscreen(const gchar *option_name, const gchar *value,
+                         gpointer data, GError **error)
+{
+    opt_inhibit_fullscreen = TRUE;
+    if (value && *value) {
+        g_strfreev(fullscreen_classes);
+        fullscreen_classes = g_strsplit(value, ",", -1);
+    }
+    return TRUE;
+}
+
+static gboolean
+parse_trigger_locker(const gchar *option_name, const gchar *value,
+                     gpointer data, GError **error)
+{
+    return settings_parse_trigger_locker(&cmdline_settings, option_name, value,
+                                         error);
+}
+
+static gboolean
+parse_idle_stage(const gchar *option_name, const gchar *value,
+                 gpointer data, GError **error)
+{
+    IdleStage stage = {0, NULL, NULL};
+    gchar *end;
+    guint64 seconds;
+    GError *parse_error = NULL;
+
+    seconds = g_ascii_strtoull(value, &end, 10);
+    if (end == value || (*end && *end != ':') || !seconds
+        || seconds > G_MAXUINT32 / 1000) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    "Invalid timeout for %s: %s", option_name, value);
+        return FALSE;
+    }
+    stage.timeout = seconds * 1000;
+
+    if (*end && end[1]
+        && !g_shell_parse_argv(end + 1, NULL, &stage.cmd, &parse_error)) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                    "Error parsing argument for %s: %s",
+                    option_name, parse_error->message);
+        g_error_free(parse_error);
+        return FALSE;
+    }
+
+    if (!idle_stages)
+        idle_stages = g_array_new(FALSE, FALSE, sizeof(IdleStage));
+    g_array_append_val(idle_stages, stage);
+    return TRUE;
+}
+
+static gint
+compare_idle_stages(gconstpointer a, gconstpointer b)
+{
+    const IdleStage *stage_a = a, *stage_b = b;
+
+    return (stage_a->timeout > stage_b->timeout)
+           - (stage_a->timeout < stage_b->timeout);
+}
+
+static gboolean
+reset_screensaver(Screen *screen)
+{
+    if (!child_running(&screen->locker)) {
+        xcb_force_screen_saver(screen->connection, XCB_SCREEN_SAVER_RESET);
+        xcb_flush(screen->connection);
+    }
+    return TRUE;
+}
+
+static gboolean
+dump_stats(gpointer user_data)
+{
+    gchar *json;
+    GError *error = NULL;
+
+    stats_count_wakeup(STATS_WAKEUP_SIGNAL);
+    trace_record(TRACE_INPUT_SIGNAL, 0, 0, 0, 0, SIGUSR2);
+
+    json = stats_to_json();
+    if (!opt_stats_file)
+        g_print("%s\n", json);
+    else if (!g_file_set_contents(opt_stats_file, json, -1, &error)) {
+        g_warning("Error writing statistics to %s: %s",
+                  opt_stats_file, error->message);
+        g_error_free(error);
+    }
+    g_free(json);
+    return TRUE;
+}
+
+/* The directory is watched rather than the file, so that editors that rename
+ * a new file over the old one are noticed as well.
+ */
+static void
+watch_config(void)
+{
+    gchar *directory = g_path_get_dirname(opt_config);
+
+    config_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (config_watch_fd < 0
+        || inotify_add_watch(config_watch_fd, directory,
+                             IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        g_warning("Not watching %s for changes: %s", opt_config,
+                  g_strerror(errno));
+        if (config_watch_fd >= 0)
+            close(config_watch_fd);
+        config_watch_fd = -1;
+    } else {
+        stats_source_added();
+        config_watch = g_unix_fd_add_full(PRIORITY_HOUSEKEEPING,
+                                          config_watch_fd, G_IO_IN,
+                                          config_changed_cb, NULL,
+                                          stats_source_removed);
+    }
+    g_free(directory);
+}
+
+static gboolean
+config_changed_cb(gint fd, GIOCondition condition, gpointer user_data)
+{
+    gchar buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    gchar *name = g_path_get_basename(opt_config);
+    gboolean changed = FALSE;
+    ssize_t length, offset;
+
+    stats_count_wakeup(STATS_WAKEUP_CONFIG);
+
+    while ((length = read(fd, buf, sizeof(buf))) > 0)
+        for (offset = 0; offset < length;
+             offset += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)(buf + offset);
+            if (event->len && !strcmp(event->name, name))
+                changed = TRUE;
+        }
+    g_free(name);
+
+    if (changed)
+        load_config();
+    return TRUE;
+}
+
+static gboolean
+reload_config(gpointer user_data)
+{
+    stats_count_wakeup(STATS_WAKEUP_SIGNAL);
+    trace_record(TRACE_INPUT_SIGNAL, 0, 0, 0, 0, SIGUSR1);
+
+    load_config();
+    return TRUE;
+}
+
+/* Nothing changes unless the whole file is valid */
+static void
+load_config(void)
+{
+    Settings *new_settings;
+    GError *error = NULL;
+
+    if (!(new_settings = settings_new(&cmdline_settings, opt_config, &error))) {
+        g_warning("Keeping current settings: %s", error->message);
+        g_error_free(error);
+        return;
+    }
+    g_message("Settings reloaded");
+    apply_settings(new_settings);
+}
+
+/* The X registration, the sleep delay lock and running children are kept;
+ * children only point into the settings, so before the old settings go, the
+ * locker is pointed at the new command for the trigger it was started by (or
+ * the default locker if that trigger has none now), which is what it is
+ * respawned with, and the standby, which only ever stands in for the default
+ * locker, at the new default. A waiting standby locker for a command that
+ * changed is replaced.
+ */
+static void
+apply_settings(Settings *new_settings)
+{
+    Settings *old_settings = settings;
+    gboolean locker_changed;
+    GSList *link;
+
+    settings = new_settings;
+    locker_changed = !cmd_equal(old_settings->locker_cmd, settings->locker_cmd);
+
+    for (link = screens; link; link = link->next) {
+        Screen *screen = link->data;
+
+        screen->notifier.cmd = settings->notifier_cmd;
+        screen->notifier.path = settings->notifier_path;
+        use_locker_for(&screen->locker, screen->locker.trigger);
+        screen->standby.cmd = settings->locker_cmd;
+        screen->standby.path = settings->locker_path;
+
+        if (!opt_standby || !locker_changed)
+            continue;
+        if (screen->standby.pid) {
+            /* Restarted by standby_watch_cb, without counting as a failure */
+            screen->standby_start_time = 0;
+            kill_child(&screen->standby);
+        } else if (!screen->locker.standby) {
+            screen->locker.standby = &screen->standby;
+            if (!child_running(&screen->locker))
+                start_standby(&screen->standby);
+        }
+    }
+
+    if (system_bus)
+        logind_manager_watch_sleep(!settings->ignore_sleep, FALSE);
+    settings_free(old_settings);
+}
+
+static gboolean
+cmd_equal(gchar **a, gchar **b)
+{
+    while (a && b && *a && *b && !strcmp(*a, *b))
+        a++, b++;
+    return (!a || !*a) && (!b || !*b);
+}
+
+static gboolean
+exit_service(GMainLoop *loop)
+{
+    GSList *link;
+
+    stats_count_wakeup(STATS_WAKEUP_SIGNAL);
+    /* SIGINT and SIGHUP alike */
+    trace_record(TRACE_INPUT_SIGNAL, 0, 0, 0, 0, SIGTERM);
+
+    for (link = screens; link; link = link->next) {
+        Screen *screen = link->data;
+
+        stop_notifier(screen);
+        kill_child(&screen->locker);
+        kill_child(&screen->standby);
+        kill_idle_children(screen);
+    }
+    g_main_loop_quit(loop);
+    return TRUE;
+}
+
+/* Feeds the recorded inputs to the same handlers, in order, on a virtual
+ * clock that only moves with the trace; timeouts due in between run at their
+ * own time. Children are not actually started (see spawn_set_dry_run()), and
+ * every action that would reach outside is printed instead.
+ */
+static gboolean
+replay(GMainLoop *loop, GError **error)
+{
+    Trace *trace;
+    gint64 count[TRACE_N_INPUTS] = {0}, total[TRACE_N_INPUTS] = {0};
+    gint64 max[TRACE_N_INPUTS] = {0};
+    gint64 wall_start, wall_time;
+    gchar *json;
+    guint i;
+
+    if (!(trace = trace_load(opt_replay, error)))
+        return FALSE;
+    if (trace->screens != g_slist_length(screens)) {
+        g_set_error(error, TRACE_ERROR, 0,
+                    "%s was recorded with %u screens instead of %u", opt_replay,
+                    trace->screens, g_slist_length(screens));
+        trace_free(trace);
+        return FALSE;
+    }
+
+    trace_clock_start(trace->start_time);
+    replay_start_time = trace->start_time;
+    spawn_set_dry_run(TRUE);
+    if (!settings->ignore_sleep)
+        logind_manager_take_sleep_delay_lock(FALSE);
+
+    wall_start = g_get_monotonic_time();
+    for (i = 0; i < trace->records->len; i++) {
+        const TraceRecord *record = &g_array_index(trace->records, TraceRecord, i);
+        gint64 input_start;
+        gboolean go_on;
+
+        trace_clock_advance(record->time);
+        while (g_main_context_iteration(NULL, FALSE));
+
+        input_start = g_get_monotonic_time();
+        go_on = replay_record(loop, g_slist_nth_data(screens, record->screen),
+                              record);
+        while (g_main_context_iteration(NULL, FALSE));
+        wall_time = g_get_monotonic_time() - input_start;
+
+        count[record->input]++;
+        total[record->input] += wall_time;
+        max[record->input] = MAX(max[record->input], wall_time);
+        if (!go_on)
+            break;
+    }
+    wall_time = g_get_monotonic_time() - wall_start;
+
+    g_print("# %u inputs, %.3f s replayed in %.3f s\n", trace->records->len,
+            (trace_now() - trace->start_time) / 1e6, wall_time / 1e6);
+    g_print("# %-15s %8s %10s %10s\n", "input", "count", "mean us", "max us");
+    for (i = 0; i < TRACE_N_INPUTS; i++)
+        if (count[i])
+            g_print("# %-15s %8" G_GINT64_FORMAT " %10" G_GINT64_FORMAT
+                    " %10" G_GINT64_FORMAT "\n", trace_input_name(i), count[i],
+                    total[i] / count[i], max[i]);
+    json = stats_to_json();
+    g_print("%s\n", json);
+    g_free(json);
+
+    trace_free(trace);
+    return TRUE;
+}
+
+/* Returns FALSE once the service would have exited */
+static gboolean
+replay_record(GMainLoop *loop, Screen *screen, const TraceRecord *record)
+{
+    Child *child;
+    GVariant *parameters;
+
+    switch (record->input) {
+    case TRACE_INPUT_SAVER: {
+        xcb_screensaver_notify_event_t event = {0};
+
+        event.response_type = screen->screensaver_notify;
+        event.state = record->args[0];
+        event.kind = record->args[1];
+        event.forced = record->args[2];
+        screensaver_event_cb(screen->connection, (xcb_generic_event_t *)&event,
+                             screen);
+        break;
+    }
+    case TRACE_INPUT_IDLE_ALARM: {
+        xcb_sync_alarm_notify_event_t event = {0};
+
+        if (!screen->idle_alarms || (record->args[0] != TRACE_IDLE_RESET
+                                     && record->args[0] >= idle_stages->len))
+            break;
+        event.response_type = screen->sync_notify + XCB_SYNC_ALARM_NOTIFY;
+        event.alarm = record->args[0] == TRACE_IDLE_RESET
+                      ? screen->idle_reset_alarm
+                      : screen->idle_alarms[record->args[0]];
+        screensaver_event_cb(screen->connection, (xcb_generic_event_t *)&event,
+                             screen);
+        break;
+    }
+    case TRACE_INPUT_SLEEP:
+        if (settings->ignore_sleep)
+            break;
+        parameters = g_variant_ref_sink(g_variant_new("(b)", record->args[0]));
+        logind_manager_on_signal_prepare_for_sleep(NULL, "PrepareForSleep",
+                                                   parameters, NULL);
+        g_variant_unref(parameters);
+        break;
+    case TRACE_INPUT_SESSION_LOCK:
+        logind_session_on_signal_lock(NULL, record->args[0] ? "Lock" : "Unlock",
+                                      NULL, screen);
+        break;
+    case TRACE_INPUT_CHILD_EXIT:
+        if (!(child = child_by_id(screen, record->args[0])) || !child->pid)
+            break;
+        spawn_dry_run_release(child->pid);
+        if (record->args[1]) {
+            /* Stands in for whatever the child left behind */
+            Adopted *adopted = g_new0(Adopted, 1);
+
+            adopted->pidfd = -1;
+            adopted->child = child;
+            child->adopted = g_slist_prepend(child->adopted, adopted);
+        }
+        child->exit_func(child->pid, record->value, child);
+        break;
+    case TRACE_INPUT_CHILD_FINISHED:
+        if (!(child = child_by_id(screen, record->args[0])) || !child->adopted)
+            break;
+        g_slist_free_full(child->adopted, g_free);
+        child->adopted = NULL;
+        child->failed = exit_abnormal(record->value);
+        if (!child->pid)
+            child_finished(child);
+        break;
+    case TRACE_INPUT_LOCKER_READY:
+        if (screen->locker.pid)
+            spawn_dry_run_release(screen->locker.pid);
+        break;
+    case TRACE_INPUT_INHIBIT:
+        screen->saver_suspended = record->args[0];
+        break;
+    case TRACE_INPUT_SIGNAL:
+        if (record->value == SIGUSR1) {
+            reload_config(NULL);
+        } else if (record->value == SIGTERM) {
+            exit_service(loop);
+            return FALSE;
+        }
+        break;
+    default:
+        break;
+    }
+    return TRUE;
+}
+
+/* Requests on an error connection go nowhere; the event codes and alarms are
+ * made up for replay_record() to match.
+ */
+static void
+replay_screen_setup(Screen *screen)
+{
+    static xcb_screen_t xcb_screen;
+    guint i;
+
+    screen->connection = xcb_connect_to_fd(-1, NULL);
+    screen->xcb_screen = &xcb_screen;
+    screen->screensaver_notify = 64;
+    screen->sync_notify = 70;
+    screen->session_path = g_strdup("/replay");
+    if (idle_stages) {
+        screen->idle_alarms = g_new(xcb_sync_alarm_t, idle_stages->len);
+        for (i = 0; i < idle_stages->len; i++)
+            screen->idle_alarms[i] = i + 1;
+        screen->idle_reset_alarm = idle_stages->len + 1;
+    }
+}
+
+static void
+replay_action(Screen *screen, const gchar *format, ...)
+{
+    va_list args;
+    gchar *action;
+
+    if (!opt_replay)
+        return;
+
+    va_start(args, format);
+    action = g_strdup_vprintf(format, args);
+    va_end(args);
+    g_print("%10.3f %s %s\n", (trace_now() - replay_start_time) / 1e3,
+            screen && screen->display ? screen->display : "-", action);
+    g_free(action);
+}
+
+static void
+log_handler(const gchar *log_domain, GLogLevelFlags log_level,
+            const gchar *message, gpointer user_data)
+{
+    if (opt_verbose || log_level & G_LOG_FLAG_FATAL
+        || !(opt_quiet || log_level & G_LOG_LEVEL_MESSAGE))
+        g_log_default_handler(log_domain, log_level, message, user_data);
+}
+
+int
+main(int argc, char *argv[])
+{
+    GMainLoop *loop;
+    GError *error = NULL;
+    GSList *link;
+    gchar **attach;
+    guint i;
+
+    start_time = trace_now();
+    setlocale(LC_ALL, "");
+    tracked_pids = g_hash_table_new(NULL, NULL);
+    
+    if (!parse_options(argc, argv, &error) || opt_print_version) {
+        if (opt_print_version) {
+            g_print(VERSION "\n");
+            g_clear_error(&error);
+        }
+        goto init_error;
+    }
+    g_log_set_default_handler(log_handler, NULL);
+    g_log_set_fatal_mask(NULL, G_LOG_LEVEL_CRITICAL);
+
+    /* An inherited SIG_IGN would have the kernel reap children before they
+     * can be waited for
+     */
+    signal(SIGCHLD, SIG_DFL);
+
+    /* Without a children list (CONFIG_PROC_CHILDREN), orphans could not be
+     * found to be reaped, so they are better left to init.
+     */
+    if (!opt_replay) {
+        gchar *children = g_strdup_printf("/proc/self/task/%d/children", getpid());
+
+        if (!g_file_test(children, G_FILE_TEST_EXISTS))
+            g_debug("Cannot track forking children: %s is missing", children);
+        else if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0)
+            g_debug("Cannot track forking children: %s", g_strerror(errno));
+        else
+            subreaper = TRUE;
+        g_free(children);
+    }
+
+    if (opt_sleep_nice != G_MAXINT) {
+        errno = 0;
+        base_nice = getpriority(PRIO_PROCESS, 0);
+        if (errno)
+            base_nice = 0;
+        spawn_set_nice(base_nice);
+    }
+
+    /* Not meant for the children */
+    notify_socket = g_strdup(g_getenv("NOTIFY_SOCKET"));
+    g_unsetenv("NOTIFY_SOCKET");
+
+    if (!opt_attach)
+        screens = g_slist_append(screens, screen_new(NULL, opt_session));
+    for (attach = opt_attach; attach && *attach; attach++) {
+        gchar **display_session = g_strsplit(*attach, ",", 2);
+
+        screens = g_slist_append(screens, screen_new(display_session[0],
+                                                     display_session[1]));
+        g_strfreev(display_session);
+    }
+
+    if (opt_replay) {
+        /* A standby locker's life is not part of the trace */
+        opt_standby = FALSE;
+        opt_sleep_nice = G_MAXINT;
+        for (link = screens; link; link = link->next)
+            replay_screen_setup(link->data);
+        loop = g_main_loop_new(NULL, FALSE);
+        if (!replay(loop, &error)) {
+            g_main_loop_unref(loop);
+            goto init_error;
+        }
+        goto stop;
+    }
+
+    if (opt_record && !trace_record_start(opt_record, g_slist_length(screens),
+                                          start_time, &error))
+        goto init_error;
+
+    /* The bus connection is made meanwhile */
+    startup_pending = 1;
+    bus_get_system(PRIORITY_LOCK, system_bus_get_cb, NULL);
+
+    for (link = screens; link; link = link->next)
+        if (!screen_connect(link->data, &error)
+            || !register_screensaver(link->data, &error)
+            || (idle_stages && !register_idle_alarms(link->data, &error)))
+            goto init_error;
+    stats_record_startup(STATS_STARTUP_ARMED, start_time);
+
+    for (link = screens; link && dim_duration >= 0; link = link->next) {
+        Screen *screen = link->data;
+
+        screen->backlight = backlight_new(screen->connection,
+                                          screen->xcb_screen->root, &error);
+        if (!screen->backlight) {
+            g_warning("Not dimming %s: %s",
+                      screen->display ? screen->display : "the screen",
+                      error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    for (link = screens; link && opt_inhibit_fullscreen; link = link->next) {
+        Screen *screen = link->data;
+
+        screen->fullscreen = fullscreen_new(screen->connection,
+                                            screen->xcb_screen->root,
+                                            fullscreen_classes, &error);
+        if (!screen->fullscreen) {
+            g_warning("Not watching for fullscreen windows on %s: %s",
+                      screen->display ? screen->display : "the screen",
+                      error->message);
+            g_clear_error(&error);
+        } else {
+            update_inhibit(screen);
+        }
+    }
 
     loop = g_main_loop_new(NULL, FALSE);
     g_unix_signal_add(SIGTERM, (GSourceFunc)exit_service, loop);
     g_unix_signal_add(SIGINT,  (GSourceFunc)exit_service, loop);
     g_unix_signal_add(SIGHUP,  (GSourceFunc)exit_service, loop);
+    g_unix_signal_add_full(PRIORITY_HOUSEKEEPING, SIGUSR1, reload_config,
+                           NULL, NULL);
+    g_unix_signal_add_full(PRIORITY_HOUSEKEEPING, SIGUSR2, dump_stats,
+                           NULL, NULL);
+    if (opt_config)
+        watch_config();
 
-    default_screen = xcb_aux_get_screen(connection, default_screen_number);
-    if (!register_screensaver(connection, default_screen, &atom, &error))
-        goto init_error;
+    if (opt_inhibit_service)
+        inhibit_service_start(inhibit_changed_cb, NULL);
+
+    for (link = screens; link && opt_standby; link = link->next) {
+        Screen *screen = link->data;
+
+        screen->locker.standby = &screen->standby;
+        start_standby(&screen->standby);
+    }
 
     g_main_loop_run(loop);
 
-    unregister_screensaver(connection, default_screen, atom);
+stop:
+    inhibit_service_stop();
+    for (link = screens; link; link = link->next) {
+        unregister_idle_alarms(link->data);
+        unregister_screensaver(link->data);
+    }
     g_main_loop_unref(loop);
+    if (config_watch) g_source_remove(config_watch);
+    if (config_watch_fd >= 0) close(config_watch_fd);
     if (sleep_lock_fd >= 0) close(sleep_lock_fd);
-    if (logind_manager) g_object_unref(logind_manager);
-    if (logind_session) g_object_unref(logind_session);
+    if (prepare_for_sleep_subscription)
+        bus_unsubscribe(system_bus, prepare_for_sleep_subscription);
 
 init_error:
-    g_strfreev(notifier.cmd);
-    g_strfreev(locker.cmd);
-    if (connection) xcb_disconnect(connection);
+    trace_record_stop();
+    g_slist_free_full(screens, (GDestroyNotify)screen_free);
+    if (system_bus) bus_free(system_bus);
+    settings_free(settings);
+    settings_clear(&cmdline_settings);
+    g_strfreev(opt_attach);
+    g_strfreev(fullscreen_classes);
+    g_free(notify_socket);
+    if (idle_stages) {
+        for (i = 0; i < idle_stages->len; i++) {
+            IdleStage *stage = &g_array_index(idle_stages, IdleStage, i);
+
+            g_strfreev(stage->cmd);
+            g_free(stage->path);
+        }
+        g_array_free(idle_stages, TRUE);
+    }
+    g_free(opt_stats_file);
+    g_free(opt_config);
+    g_free(opt_record);
+    g_free(opt_replay);
 
     if (error) {
         g_printerr("%s\n", error->message);